@@ -0,0 +1,60 @@
+#include <idblib/idb3.h>
+#include "benchmark.h"
+#include "benchdb.h"
+
+static const int versions[] = { 15, 16, 20 };
+
+BENCHMARK(btreefind)
+{
+    static const std::pair<relation_t, const char*> relations[] = {
+        { REL_LESS, "REL_LESS" },
+        { REL_LESS_EQUAL, "REL_LESS_EQUAL" },
+        { REL_EQUAL, "REL_EQUAL" },
+        { REL_GREATER_EQUAL, "REL_GREATER_EQUAL" },
+        { REL_GREATER, "REL_GREATER" },
+    };
+    for (int version : versions) {
+        auto& db = benchdatabase(version, bench.size());
+
+        // half of the keys exist, the other half fall between two records.
+        BenchRandom rnd;
+        std::vector<std::string> keys;
+        for (int i=0 ; i<1000 ; i++) {
+            uint64_t ea = db.synth.address(rnd.next(db.synth.nnames()));
+            keys.push_back(db.id0->makekey(ea + (i&1 ? 8 : 0), 'N'));
+        }
+
+        for (auto& rel : relations) {
+            bench.measure(stringformat("v%d %s", version, rel.second), keys.size(), [&]() {
+                for (auto& key : keys) {
+                    auto c = db.id0->find(rel.first, key);
+                    benchsink(c.eof());
+                }
+            });
+        }
+    }
+}
+
+BENCHMARK(btreescan)
+{
+    for (int version : versions) {
+        auto& db = benchdatabase(version, bench.size());
+
+        uint64_t nrecs = 0;
+        for (auto c = db.id0->find(REL_GREATER_EQUAL, "") ; !c.eof() ; c.next())
+            nrecs++;
+
+        bench.measure(stringformat("v%d next", version), nrecs, [&]() {
+            uint64_t bytes = 0;
+            for (auto c = db.id0->find(REL_GREATER_EQUAL, "") ; !c.eof() ; c.next())
+                bytes += c.getkey().size() + c.getval().size();
+            benchsink(bytes);
+        });
+        bench.measure(stringformat("v%d prev", version), nrecs, [&]() {
+            uint64_t bytes = 0;
+            for (auto c = db.id0->find(REL_LESS_EQUAL, "\xff") ; !c.eof() ; c.prev())
+                bytes += c.getkey().size() + c.getval().size();
+            benchsink(bytes);
+        });
+    }
+}
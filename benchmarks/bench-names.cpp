@@ -0,0 +1,79 @@
+#include <idblib/idb3.h>
+#include "benchmark.h"
+#include "benchdb.h"
+
+BENCHMARK(getname)
+{
+    auto& db = benchdatabase(20, bench.size());
+
+    BenchRandom rnd;
+    std::vector<uint64_t> shortnames, longnames;
+    while (shortnames.size() < 1000 || longnames.size() < 1000) {
+        uint64_t i = rnd.next(db.synth.nnames());
+        auto& list = db.synth.islongname(i) ? longnames : shortnames;
+        if (list.size() < 1000)
+            list.push_back(db.synth.address(i));
+    }
+
+    bench.measure("getname, short names", shortnames.size(), [&]() {
+        for (auto ea : shortnames)
+            benchsink(db.id0->getname(ea).size());
+    });
+    bench.measure("getname, long names", longnames.size(), [&]() {
+        for (auto ea : longnames)
+            benchsink(db.id0->getname(ea).size());
+    });
+    bench.measure("node(name)", 1000, [&]() {
+        for (int i=0 ; i<1000 ; i++)
+            benchsink(db.id0->node(db.synth.structname(i%db.synth.nstructs())));
+    });
+}
+
+BENCHMARK(structs)
+{
+    auto& db = benchdatabase(20, bench.size());
+    uint64_t nstructs = db.synth.nstructs();
+
+    bench.measure("Struct", nstructs, [&]() {
+        for (uint64_t i=0 ; i<nstructs ; i++) {
+            Struct s(*db.id0, db.synth.structnode(i));
+            benchsink(s.size());
+        }
+    });
+    bench.measure("List<Struct>", nstructs, [&]() {
+        for (auto list = List<Struct>(*db.id0, db.synth.structlist()) ; !list.eof() ; )
+            benchsink(list.next().nmembers());
+    });
+}
+
+BENCHMARK(namfind)
+{
+    auto& db = benchdatabase(20, bench.size());
+    auto ea0 = db.synth.address(0);
+    auto ea1 = db.synth.address(db.synth.nnames());
+
+    BenchRandom rnd;
+    std::vector<uint64_t> addrs;
+    for (int i=0 ; i<10000 ; i++)
+        addrs.push_back(ea0 + rnd.next(ea1-ea0));
+
+    NAMFile nam(*db.idb, db.nam);
+    nam.numnames();     // load the offsets before measuring
+
+    bench.measure("findname, binary search", addrs.size(), [&]() {
+        for (auto ea : addrs)
+            benchsink(nam.findname(ea));
+    });
+    nam.buildsearchindex();
+    bench.measure("findname, eytzinger", addrs.size(), [&]() {
+        for (auto ea : addrs)
+            benchsink(nam.findname(ea));
+    });
+
+    auto sorted = addrs;
+    std::sort(sorted.begin(), sorted.end());
+    bench.measure("findnames, sorted batch", sorted.size(), [&]() {
+        auto named = nam.findnames(sorted);
+        benchsink(named.back());
+    });
+}
@@ -0,0 +1,83 @@
+#include <idblib/idb3.h>
+#include <idblib/idbwriter.h>
+#include "benchmark.h"
+
+// a struct spec like stored in (structnode, 'M', 0), with `n` members.
+// member sizes and flags vary pseudo randomly, so the encoding lengths are not predictable.
+static std::string makestructspec(int n)
+{
+    uint32_t rnd = 12345;
+    auto random = [&rnd]() { rnd = rnd*1103515245 + 12345; return rnd>>8; };
+    static const uint32_t flags[] = { 0x400, 0x20000400, 0x10000400, 0x50000400, 0x60000400 };
+
+    std::string spec;
+    idapack32(spec, 0);       // flags
+    idapack32(spec, n);
+    for (int i=0 ; i<n ; i++) {
+        idapack32(spec, 0x1000+i*(random()%0x40));    // member nodeid
+        idapack32(spec, random()%4 ? 0 : random()%0x100);  // skip
+        idapack32(spec, 1<<(random()%16));            // size
+        idapack32(spec, flags[random()%5]);           // flags
+        idapack32(spec, random()%2);                  // props
+    }
+    idapack32(spec, 1);       // seqnr
+    return spec;
+}
+
+// decode the members the way StructMember does.
+template<typename UNPACKER>
+static uint64_t decodespec(UNPACKER& p)
+{
+    uint64_t sum = p.next32();
+    uint32_t n = p.next32();
+    while (n--) {
+        sum += p.nextword();
+        sum += p.nextword();
+        sum += p.nextword();
+        sum += p.next32();
+        sum += p.next32();
+    }
+    return sum;
+}
+
+BENCHMARK(unpack)
+{
+    auto spec = makestructspec(1000);
+    auto first = (const uint8_t*)spec.data();
+    auto last = first + spec.size();
+
+    bench.measure("Unpacker<string::iterator>, virtual", 5000, [&]() {
+        auto p = makeunpacker(spec.cbegin(), spec.cend(), false);
+        BaseUnpacker& base = p;
+        benchsink(decodespec(base));
+    });
+    bench.measure("Unpacker<const uint8_t*>", 5000, [&]() {
+        auto p = makeunpacker(first, last, false);
+        benchsink(decodespec(p));
+    });
+    bench.measure("FastUnpacker<false>", 5000, [&]() {
+        FastUnpacker<false> p(first, last);
+        benchsink(decodespec(p));
+    });
+}
+
+BENCHMARK(unpackblob)
+{
+    // a blob like the segment and history records: mostly small values.
+    uint32_t rnd = 12345;
+    std::string blob;
+    for (int i=0 ; i<4000 ; i++) {
+        rnd = rnd*1103515245 + 12345;
+        idapack32(blob, (rnd>>8)%16 ? (rnd>>12)%0x80 : rnd>>4);
+    }
+
+    bench.measure("idaunpack, back_inserter", 4000, [&]() {
+        DwordVector values;
+        idaunpack(blob.begin(), blob.end(), std::back_inserter(values));
+        benchsink(values.size());
+    });
+    bench.measure("idaunpack32", 4000, [&]() {
+        auto values = idaunpack32(blob);
+        benchsink(values.size());
+    });
+}
@@ -0,0 +1,58 @@
+/*
+ * benchdb.h: synthetic databases for the benchmarks.
+ *
+ * The databases are generated with SyntheticID0, and cached, so
+ * all benchmarks for the same version and size share one database.
+ */
+#pragma once
+#include <idblib/idb3.h>
+#include <idblib/idbwriter.h>
+#include <map>
+
+struct BenchDatabase {
+    SyntheticID0 synth;
+    std::unique_ptr<IDBFile> idb;   // only provides the magic for ID0File
+    std::unique_ptr<ID0File> id0;
+    std::shared_ptr<std::stringstream> nam;
+
+    BenchDatabase(int version, uint64_t size)
+        : synth(4, size)
+    {
+        auto data = std::make_shared<std::stringstream>();
+        BtreeWriter bw(*data, version);
+        synth.generate([&](const std::string& key, const std::string& val) { bw.add(key, val); });
+        bw.finish();
+
+        std::string hdr(30, char(0));
+        EndianTools::setle32(hdr.begin(), hdr.end(), IDBFile::MAGIC_IDA1);
+        idb = std::make_unique<IDBFile>(std::make_shared<std::stringstream>(hdr));
+        id0 = std::make_unique<ID0File>(*idb, data);
+
+        std::vector<uint64_t> offsets;
+        for (uint64_t i=0 ; i<size ; i++)
+            offsets.push_back(synth.address(i));
+        nam = std::make_shared<std::stringstream>();
+        writenamsection(*nam, offsets, 4);
+    }
+};
+
+inline BenchDatabase& benchdatabase(int version, uint64_t size)
+{
+    static std::map<std::pair<int, uint64_t>, std::unique_ptr<BenchDatabase>> cache;
+    auto& db = cache[std::make_pair(version, size)];
+    if (!db)
+        db = std::make_unique<BenchDatabase>(version, size);
+    return *db;
+}
+
+// pseudo random numbers, so all runs use the same keys.
+class BenchRandom {
+    uint64_t _state;
+public:
+    BenchRandom(uint64_t seed = 12345) : _state(seed) { }
+    uint64_t next(uint64_t n)
+    {
+        _state = _state*6364136223846793005ULL + 1442695040888963407ULL;
+        return (_state>>33) % n;
+    }
+};
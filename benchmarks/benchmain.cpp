@@ -0,0 +1,58 @@
+/*
+ * benchmarks: timing of the idb3.h hot paths.
+ *
+ * Author: Willem Hengeveld <itsme@xs4all.nl>
+ *
+ */
+#include <cstring>
+#include <algorithm>
+#include <cstdlib>
+#include <cpputils/formatter.h>
+#include "benchmark.h"
+
+void usage()
+{
+    printf("benchmarks [--json] [--mintime SECONDS] [--size N] [NAMES...]\n");
+    printf("    runs all benchmarks, or only those whose name contains one of NAMES\n");
+    printf("    --json    output one json object per result line\n");
+    printf("    --size    nr of names in the generated databases, default 100000\n");
+}
+
+int main(int argc, char**argv)
+{
+    bool json = false;
+    double mintime = 0.2;
+    uint64_t size = 100000;
+    std::vector<std::string> filters;
+
+    for (int i=1 ; i<argc ; i++) {
+        if (strcmp(argv[i], "--json")==0)
+            json = true;
+        else if (strcmp(argv[i], "--mintime")==0 && i+1<argc)
+            mintime = atof(argv[++i]);
+        else if (strcmp(argv[i], "--size")==0 && i+1<argc)
+            size = strtoull(argv[++i], 0, 0);
+        else if (argv[i][0]=='-') {
+            usage();
+            return 1;
+        }
+        else
+            filters.push_back(argv[i]);
+    }
+
+    for (auto& bm : benchmarklist()) {
+        if (!filters.empty() && std::none_of(filters.begin(), filters.end(), [&](const std::string& f) { return bm.first.find(f)!=bm.first.npos; }))
+            continue;
+
+        Bench bench(mintime, size);
+        bm.second(bench);
+
+        for (auto& r : bench.results()) {
+            if (json)
+                print("{\"benchmark\":\"%s\",\"name\":\"%s\",\"size\":%d,\"ops\":%d,\"seconds\":%.6f,\"ns_per_op\":%.3f}\n", bm.first, r.name, size, r.ops, r.seconds, r.nsperop());
+            else
+                print("%-16s %-40s %12d ops %10.3f ns/op\n", bm.first, r.name, r.ops, r.nsperop());
+        }
+    }
+    return 0;
+}
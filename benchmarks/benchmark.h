@@ -0,0 +1,87 @@
+/*
+ * benchmark.h: a minimal harness for the idblib benchmarks.
+ *
+ * Define a benchmark with:
+ *
+ *    BENCHMARK(name)
+ *    {
+ *        bench.measure("label", nops, [&]() { ... });
+ *    }
+ *
+ * `measure` repeatedly calls the function, which is expected to perform `nops`
+ * operations, until `mintime` seconds have passed.
+ *
+ * `bench.size()` is the nr of records benchmarks should use for generated databases.
+ */
+#pragma once
+#include <chrono>
+#include <string>
+#include <vector>
+#include <utility>
+
+struct BenchResult {
+    std::string name;
+    uint64_t ops;
+    double seconds;
+
+    double nsperop() const { return ops ? seconds*1e9/ops : 0; }
+};
+
+class Bench {
+    double _mintime;
+    uint64_t _size;
+    std::vector<BenchResult> _results;
+public:
+    Bench(double mintime, uint64_t size)
+        : _mintime(mintime), _size(size)
+    {
+    }
+    uint64_t size() const { return _size; }
+
+    template<typename FN>
+    void measure(const std::string& name, uint64_t nops, FN fn)
+    {
+        typedef std::chrono::steady_clock clock;
+
+        fn();  // warmup
+
+        uint64_t total = 0;
+        std::chrono::duration<double> elapsed(0);
+        do {
+            auto t0 = clock::now();
+            fn();
+            elapsed += clock::now() - t0;
+            total += nops;
+        } while (elapsed.count() < _mintime);
+
+        _results.push_back(BenchResult{name, total, elapsed.count()});
+    }
+
+    const std::vector<BenchResult>& results() const { return _results; }
+};
+
+typedef void (*benchfn_t)(Bench&);
+
+inline std::vector<std::pair<std::string, benchfn_t>>& benchmarklist()
+{
+    static std::vector<std::pair<std::string, benchfn_t>> list;
+    return list;
+}
+struct BenchRegistrar {
+    BenchRegistrar(const char *name, benchfn_t fn)
+    {
+        benchmarklist().emplace_back(name, fn);
+    }
+};
+
+#define BENCHMARK(name) \
+    static void bench_##name(Bench& bench); \
+    static BenchRegistrar registrar_##name(#name, bench_##name); \
+    static void bench_##name(Bench& bench)
+
+// keeps the compiler from optimizing away the benchmarked code.
+inline void benchsink(uint64_t value)
+{
+    static volatile uint64_t sink;
+    sink = sink + value;
+}
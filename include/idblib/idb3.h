@@ -5,21 +5,152 @@
  *
  *
  * Toplevel class: IDBFile, use getsection to get a stream to the desired section,
- * Then create an ID0File, ID1File, NAMFile for that section.
+ * Then create an ID0File, ID1File, NAMFile or TILFile for that section.
  * 
  */
+#pragma once
 #include <iostream>
 #include <sstream>
 #include <vector>
 #include <set>
+#include <list>
+#include <unordered_map>
 #include <cassert>
 #include <climits>
 #include <algorithm>
 #include <memory>
+#include <cstring>
+#include <string_view>
+#include <optional>
+#include <new>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <exception>
 #include <cpputils/formatter.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 
 #define dbgprint(...)
 
+// optional instrumentation, enabled by defining IDB_WITH_STATS.
+//
+// The counters are process wide, and updated with relaxed atomics.
+// Without IDB_WITH_STATS the IDB_STAT_ macros compile to nothing.
+#ifdef IDB_WITH_STATS
+#include <chrono>
+
+struct IdbStats {
+    typedef std::atomic<uint64_t> counter_t;
+
+    // BtreeBase
+    counter_t pagesread;
+    counter_t pagecachehits;
+    counter_t finds[5];         // indexed by relation_t
+    counter_t cursorsteps;      // next and prev calls
+    counter_t decodens;         // time spent decoding pages
+
+    // sectionbuffer
+    counter_t reads;            // reads from the parent stream
+    counter_t bytesread;        // also counts btree pages read from other streams
+    counter_t seeks;            // seeks on the section stream
+    counter_t bufferhits;       // seeks within the current block
+    counter_t buffermisses;     // blocks loaded
+    counter_t iotimens;         // time spent reading the parent stream
+
+    // ID1File
+    counter_t getflags;
+
+    // NAMFile
+    counter_t findname;
+    counter_t namesloaded;
+
+    // optional callback, called after each page read with the start and end time.
+    typedef void (*pagereadhook_t)(uint32_t nr, std::chrono::steady_clock::time_point t0, std::chrono::steady_clock::time_point t1);
+    std::atomic<pagereadhook_t> pagereadhook;
+
+    // calls fn(name, counter) for all counters.
+    template<typename FN>
+    void foreach(FN fn)
+    {
+        static const char *relnames[] = { "find.less", "find.less_equal", "find.equal", "find.greater_equal", "find.greater" };
+        fn("btree.pagesread", pagesread);
+        fn("btree.pagecachehits", pagecachehits);
+        for (int i=0 ; i<5 ; i++)
+            fn(relnames[i], finds[i]);
+        fn("btree.cursorsteps", cursorsteps);
+        fn("btree.decodens", decodens);
+        fn("section.reads", reads);
+        fn("section.bytesread", bytesread);
+        fn("section.seeks", seeks);
+        fn("section.bufferhits", bufferhits);
+        fn("section.buffermisses", buffermisses);
+        fn("section.iotimens", iotimens);
+        fn("id1.getflags", getflags);
+        fn("nam.findname", findname);
+        fn("nam.namesloaded", namesloaded);
+    }
+    void reset()
+    {
+        foreach([](const char*, counter_t& c) { c.store(0, std::memory_order_relaxed); });
+    }
+};
+inline IdbStats& idbstats()
+{
+    static IdbStats stats;
+    return stats;
+}
+
+// adds the time between construction and destruction to a counter.
+class IdbStatTimer {
+    IdbStats::counter_t& _ns;
+    std::chrono::steady_clock::time_point _t0;
+public:
+    IdbStatTimer(IdbStats::counter_t& ns)
+        : _ns(ns), _t0(std::chrono::steady_clock::now())
+    {
+    }
+    ~IdbStatTimer()
+    {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _t0).count();
+        _ns.fetch_add(ns, std::memory_order_relaxed);
+    }
+};
+
+// calls the pagereadhook, when one is set.
+class IdbPageReadEvent {
+    IdbStats::pagereadhook_t _hook;
+    uint32_t _nr;
+    std::chrono::steady_clock::time_point _t0;
+public:
+    IdbPageReadEvent(uint32_t nr)
+        : _hook(idbstats().pagereadhook.load(std::memory_order_relaxed)), _nr(nr)
+    {
+        if (_hook)
+            _t0 = std::chrono::steady_clock::now();
+    }
+    ~IdbPageReadEvent()
+    {
+        if (_hook)
+            _hook(_nr, _t0, std::chrono::steady_clock::now());
+    }
+};
+
+#define IDB_STAT_ADD(counter, n) idbstats().counter.fetch_add(n, std::memory_order_relaxed)
+#define IDB_STAT_INC(counter) IDB_STAT_ADD(counter, 1)
+#define IDB_STAT_TIMER(counter) IdbStatTimer idbstattimer_##counter(idbstats().counter)
+#define IDB_STAT_PAGEREAD(nr) IdbPageReadEvent idbpagereadevent(nr)
+#else
+#define IDB_STAT_ADD(counter, n)
+#define IDB_STAT_INC(counter)
+#define IDB_STAT_TIMER(counter)
+#define IDB_STAT_PAGEREAD(nr)
+#endif
+
 // a sharedptr, so i can pass an istream around without
 // worrying about who owns it.
 typedef std::shared_ptr<std::istream> stream_ptr;
@@ -35,26 +166,6 @@ std::vector<T> getvec(int n, FN f)
 }
 
 
-////////////////////////////////////////////////////////////////////////
-// Sometimes i need to pass backinserter iterators as <first, last> pair
-// These functions make that possible.
-
-// ANY - backinserter == INT_MAX -> always enough space after a backinserter
-template<typename T, typename C>
-int operator-(T lhs, typename std::back_insert_iterator<C> rhs)
-{
-    return INT_MAX;
-}
-
-// backinserter += INT  -> does nothing
-template<typename C>
-typename std::back_insert_iterator<C>& operator+=(typename std::back_insert_iterator<C>& rhs, int n)
-{
-    return rhs;
-}
-
-
-
 // streamhelper: get little/big endian integers of various sizes from a stream
 // There are functions for 8, 16, 32, 64 bit little/big endian unsigned integers.
 // And a function for reading a database dependent word (64bit for .i64, 32bit for .idb)
@@ -114,6 +225,15 @@ public:
     }
 
 
+    // reads a word of W bytes, for loops which dispatch on the wordsize once.
+    template<int W>
+    uint64_t getword()
+    {
+        if constexpr (W==8)
+            return get64le();
+        else
+            return get32le();
+    }
     // function used to get the right wordsize for either .i64 or .idb file.
     uint64_t getword()
     {
@@ -126,7 +246,14 @@ public:
     std::string getdata(int n)
     {
         std::string str(n, char(0));
-        auto m = _is->readsome(&str.front(), n);
+        // readsome may stop at the end of a buffered block.
+        std::streamsize m = 0;
+        while (m < n) {
+            auto got = _is->readsome(&str[m], n-m);
+            if (got <= 0)
+                break;
+            m += got;
+        }
         str.resize(m);
         dbgprint("getdata -> %b\n", str);
         return str;
@@ -294,19 +421,66 @@ struct EndianTools {
 // stream buffer for sectionstream
 // This is the class doing the actual work for sectionstream.
 // This presents a view of a section of a random access stream.
+//
+// Data is read from the parent stream in aligned blocks of `bufsize` bytes,
+// so the inline sgetc/sbumpc paths of std::streambuf are used for most reads,
+// and seeks within the current block don't touch the parent stream.
+// Large reads bypass the buffer.
 class sectionbuffer : public std::streambuf {
     stream_ptr _is;
 
     std::streamoff _first;
     std::streamoff _last;
 
-    std::streampos _curpos;
+    std::vector<char> _buffer;
+    std::streamoff _bufsize;
+    std::streamoff _bufpos;   // section offset of eback()
+
+    std::streamoff size() const { return _last-_first; }
+    std::streamoff curpos() const { return _bufpos + (gptr()-eback()); }
+
+    // discard the buffer contents, and continue at `pos`.
+    void resetbuffer(std::streamoff pos)
+    {
+        _bufpos = pos;
+        setg(_buffer.data(), _buffer.data(), _buffer.data());
+    }
+
+    // read from the parent stream, `pos` is relative to the section start.
+    std::streamsize readparent(std::streamoff pos, char *p, std::streamsize n)
+    {
+        IDB_STAT_TIMER(iotimens);
+        _is->seekg(_first+pos);
+        _is->read(p, n);
+        IDB_STAT_INC(reads);
+        IDB_STAT_ADD(bytesread, _is->gcount());
+        return _is->gcount();
+    }
+
+    // load the block containing `pos`
+    bool fill(std::streamoff pos)
+    {
+        if (pos >= size())
+            return false;
+        if (_buffer.empty())
+            _buffer.resize(_bufsize);
+        IDB_STAT_INC(buffermisses);
+        std::streamoff blockstart = pos - pos%_bufsize;
+        auto got = readparent(blockstart, _buffer.data(), std::min(_bufsize, size()-blockstart));
 
+        _bufpos = blockstart;
+        if (got <= pos-blockstart) {
+            resetbuffer(pos);
+            return false;
+        }
+        setg(_buffer.data(), _buffer.data()+(pos-blockstart), _buffer.data()+got);
+        return true;
+    }
 public:
-    sectionbuffer(stream_ptr is,  uint64_t first, uint64_t last)
-        : _is(is), _first(first), _last(last), _curpos(0)
+    sectionbuffer(stream_ptr is,  uint64_t first, uint64_t last, size_t bufsize = 0x10000)
+        : _is(is), _first(first), _last(last), _bufsize(bufsize ? bufsize : 1), _bufpos(0)
     {
-        _is->seekg(_first);
+        resetbuffer(0);
     }
 protected:
     std::streampos seekoff(std::streamoff off, std::ios_base::seekdir way, std::ios_base::openmode which = std::ios_base::in | std::ios_base::out)
@@ -318,10 +492,10 @@ protected:
             newpos = off;
             break;
         case std::ios_base::cur:
-            newpos = _curpos + off;
+            newpos = curpos() + off;
             break;
         case std::ios_base::end:
-            newpos = (_last-_first) + off;
+            newpos = size() + off;
             break;
         default:
             throw std::ios_base::failure("bad seek direction");
@@ -331,42 +505,57 @@ protected:
 
     std::streampos seekpos(std::streampos sp, std::ios_base::openmode which = std::ios_base::in | std::ios_base::out)
     {
-        if (sp<0 || sp > (_last-_first))
+        std::streamoff pos = sp;
+        if (pos<0 || pos > size())
             return -1;
-        _is->seekg(sp+_first);
-        return _curpos = sp;
+        IDB_STAT_INC(seeks);
+        if (_bufpos <= pos && pos <= _bufpos + (egptr()-eback())) {
+            IDB_STAT_INC(bufferhits);
+            setg(eback(), eback()+(pos-_bufpos), egptr());
+        }
+        else {
+            resetbuffer(pos);
+        }
+        return sp;
     }
     std::streamsize showmanyc()
     {
-        return (_last-_first)-_curpos;
+        return size()-curpos();
     }
     std::streamsize xsgetn(char_type* s, std::streamsize n)
     {
-        if (n<=0 || _curpos >= (_last-_first))
-            return 0;
-        auto want = std::min(std::streamsize(_last-_first - _curpos), n);
-        //auto got = _is->readsome(s, want);
-        _is->read(s, want);  auto got = want;
-        _curpos += got;
-
-        return got;
+        std::streamsize total = 0;
+        while (n > 0) {
+            std::streamsize avail = egptr()-gptr();
+            if (avail) {
+                auto want = std::min(avail, n);
+                std::copy(gptr(), gptr()+want, s);
+                gbump(want);
+                s += want;  n -= want;  total += want;
+            }
+            else if (n >= _bufsize) {
+                // large read: directly into the destination.
+                auto pos = curpos();
+                auto want = std::min(std::streamsize(size()-pos), n);
+                if (want <= 0)
+                    break;
+                auto got = readparent(pos, s, want);
+                resetbuffer(pos+got);
+                s += got;  n -= got;  total += got;
+                if (got < want)
+                    break;
+            }
+            else if (!fill(curpos())) {
+                break;
+            }
+        }
+        return total;
     }
     int_type underflow()
     {
-        if (_curpos >= (_last-_first))
-            return traits_type::eof();
-        int r = _is->peek();
-        return r;
-    }
-    int_type uflow()
-    {
-        if (_curpos >= (_last-_first))
+        if (gptr()==egptr() && !fill(curpos()))
             return traits_type::eof();
-        int r = _is->get();
-        if (r==traits_type::eof())
-            return traits_type::eof();
-        _curpos+=1;
-        return r;
+        return traits_type::to_int_type(*gptr());
     }
 };
 // istream restricted to a section of a seakable stream
@@ -374,8 +563,8 @@ class sectionstream : public std::istream {
     sectionbuffer _buf;
 public:
     template<typename ISPTR>
-    sectionstream(ISPTR is, uint64_t from, uint64_t size)
-        : std::istream(nullptr), _buf(is, from, from+size)
+    sectionstream(ISPTR is, uint64_t from, uint64_t size, size_t bufsize = 0x10000)
+        : std::istream(nullptr), _buf(is, from, from+size, bufsize)
     {
         init(&_buf);
     }
@@ -458,6 +647,11 @@ MAGIC_IDA0 = 0x30414449,
         for (unsigned int i=0 ; i<std::max(_offsets.size(), _checksums.size()) ; i++)
             print("%d: %10llx %08x\n", i, i<_offsets.size() ? _offsets[i] : -1, i<_checksums.size() ? _checksums[i] : -1);
     }
+    // sections missing from the database have a zero offset.
+    bool hassection(int i) const
+    {
+        return i < (int)_offsets.size() && _offsets[i] != 0;
+    }
     auto getinfo(int i)
     {
         _is->seekg(_offsets[i]);
@@ -474,7 +668,10 @@ MAGIC_IDA0 = 0x30414449,
         auto info = getinfo(i);
         if (std::get<0>(info))
             throw "compression not supported";
-        return std::make_shared<sectionstream>(_is, std::get<1>(info), std::get<2>(info));
+        // section 0 is the id0 b-tree, which reads whole pages of at least 0x400 bytes.
+        // These bypass a buffer of that size, instead of each refilling a 64k block.
+        size_t bufsize = i==0 ? 0x400 : 0x10000;
+        return std::make_shared<sectionstream>(_is, std::get<1>(info), std::get<2>(info), bufsize);
     }
 };
 
@@ -488,16 +685,55 @@ enum relation_t {
     REL_RECURSE,
 };
 
+// the page layouts of the b-tree versions, used by BasePage::decodeentries.
+//
+// a page starts with a header: <preceeding> <count:16>,
+// followed by the entry table, with for index pages: <pagenr> <recofs:16>
+// and for leaf pages: <indent> ... <recofs:16>
+// v1.5 and v1.6 store the record offset minus one.
+struct PageLayout15 {
+    enum {
+        PRECEEDINGSIZE = 2,
+        ENTRYSIZE = 4,
+        PAGENRSIZE = 2,
+        INDENTSIZE = 1,
+        RECOFSADJUST = 1,
+    };
+};
+struct PageLayout16 {
+    enum {
+        PRECEEDINGSIZE = 4,
+        ENTRYSIZE = 6,
+        PAGENRSIZE = 4,
+        INDENTSIZE = 1,
+        RECOFSADJUST = 1,
+    };
+};
+// v2 b-tree pages - since idav6.7
+struct PageLayout20 {
+    enum {
+        PRECEEDINGSIZE = 4,
+        ENTRYSIZE = 6,
+        PAGENRSIZE = 4,
+        INDENTSIZE = 2,
+        RECOFSADJUST = 0,
+    };
+};
+
 // baseclass for Btree Pages
 // baseclass for Btree database, subclassed by v1.5, v1.6, v2.0
+//
+// The whole page is read with a single read, the entry table, keys and values
+// are decoded from this buffer.
 class BasePage {
 protected:
-    stream_ptr _is;
     int _pagesize;
     uint32_t _nr;
     uint32_t _preceeding;
     int _count;
 
+    std::string _data;  // the page contents
+
     // item for the entry table
     class Entry {
     public:
@@ -579,10 +815,71 @@ protected:
         bool operator>=(const PageIter& rhs) { return _ix>=rhs._ix; }
     };
 
+    // little endian integer of `N` bytes at page offset `ofs`
+    template<int N>
+    uint32_t getle(int ofs) const
+    {
+        if (ofs<0 || ofs+N > int(_data.size()))
+            throw "page: offset out of range";
+        auto p = (const uint8_t*)&_data[ofs];
+        if (N==1)
+            return p[0];
+        if (N==2)
+            return p[0] | (p[1]<<8);
+        return p[0] | (p[1]<<8) | (p[2]<<16) | (uint32_t(p[3])<<24);
+    }
+
+    template<typename LAYOUT>
+    void decodeheader()
+    {
+        _preceeding = getle<LAYOUT::PRECEEDINGSIZE>(0);
+        _count = getle<2>(LAYOUT::PRECEEDINGSIZE);
+    }
+
+    // decode the entry table
+    template<typename LAYOUT>
+    void decodeentries()
+    {
+        int ofs = LAYOUT::PRECEEDINGSIZE + 2;
+        if (ofs + _count*LAYOUT::ENTRYSIZE > int(_data.size()))
+            throw "page: entry table too large";
+
+        _index.resize(_count);
+        for (auto& ent : _index) {
+            if (isindex()) {
+                ent.pagenr = getle<LAYOUT::PAGENRSIZE>(ofs);
+            }
+            else {
+                ent.indent = getle<LAYOUT::INDENTSIZE>(ofs);
+            }
+            ent.recofs = getle<2>(ofs + LAYOUT::ENTRYSIZE - 2) + LAYOUT::RECOFSADJUST;
+            dbgprint("@%04x: ent %08x %+4d %04x\n", ofs, ent.pagenr, ent.indent, ent.recofs);
+            ofs += LAYOUT::ENTRYSIZE;
+        }
+    }
+
+    // called once per page, by readindex.
+    virtual void decodeindex() = 0;
+
+    // returns a pointer to `n` bytes at page offset `ofs`
+    const char *pagedata(int ofs, int n) const
+    {
+        if (ofs<0 || n<0 || ofs+n > int(_data.size()))
+            throw "page: record out of range";
+        return &_data[ofs];
+    }
 public:
     BasePage(stream_ptr  is, uint32_t nr, int pagesize)
-        : _is(is), _pagesize(pagesize), _nr(nr), _preceeding(0), _count(0)
-    {
+        : _pagesize(pagesize), _nr(nr), _preceeding(0), _count(0)
+    {
+        _data.resize(pagesize);
+        is->read(&_data[0], pagesize);
+        _data.resize(is->gcount());
+#ifdef IDB_WITH_STATS
+        // a sectionstream counts its own reads, pages from other streams are counted here.
+        if (!std::dynamic_pointer_cast<sectionstream>(is))
+            IDB_STAT_ADD(bytesread, _data.size());
+#endif
     }
     virtual ~BasePage() {}
     uint32_t nr() const { return _nr; }
@@ -592,8 +889,6 @@ public:
 
     size_t indexsize() const { return _index.size(); }
 
-    virtual Entry readent() = 0;
-
     void dump()
     {
         if (_preceeding)
@@ -604,8 +899,8 @@ public:
 
     void readindex()
     {
-        for (int i=0 ; i<_count ; i++)
-            _index.emplace_back(readent());
+        IDB_STAT_TIMER(decodens);
+        decodeindex();
         //print("got %d entries\n", _index.size());
 
         if (isleaf())
@@ -614,13 +909,12 @@ public:
     // for a leafpage, calculate all key values
     void readkeys()
     {
-        auto s = makehelper(_is);
         std::string key;
+        _keys.reserve(_index.size());
         for (auto & ent : _index) {
-            _is->seekg(ent.recofs);
-            int klen = s.get16le();
+            int klen = getle<2>(ent.recofs);
             key.resize(klen+ent.indent);
-            _is->read(&key[ent.indent], klen);
+            std::copy_n(pagedata(ent.recofs+2, klen), klen, &key[ent.indent]);
 
             dbgprint("key i=%d, l=%d -> %b\n", ent.indent, klen, key);
             _keys.push_back(key);
@@ -646,12 +940,10 @@ public:
     {
         auto& ent = getent(i);
         if (isindex()) {
-            _is->seekg(ent.recofs);
-            auto s = makehelper(_is);
-            int klen = s.get16le();
+            int klen = getle<2>(ent.recofs);
 
             dbgprint("indexkey(%d) -> l=%d\n", i, klen);
-            return s.getdata(klen);
+            return std::string(pagedata(ent.recofs+2, klen), klen);
         }
         else if (isleaf()) {
             dbgprint("leafkey(%d)\n", i);
@@ -659,18 +951,35 @@ public:
         }
         throw "not a leaf of index";
     }
+    // get a view on the key for the item at position `i`,
+    // only valid as long as this page is alive.
+    std::string_view keyref(int i)
+    {
+        auto& ent = getent(i);
+        if (isindex()) {
+            int klen = getle<2>(ent.recofs);
+            return std::string_view(pagedata(ent.recofs+2, klen), klen);
+        }
+        return _keys[i];
+    }
+    // get a view on the value for the item at position `i`,
+    // only valid as long as this page is alive.
+    std::string_view valref(int i)
+    {
+        auto& ent = getent(i);
+        int klen = getle<2>(ent.recofs);
+        int vlen = getle<2>(ent.recofs+2+klen);
+        return std::string_view(pagedata(ent.recofs+4+klen, vlen), vlen);
+    }
     // get value for the item at position `i`
     std::string getval(int i)
     {
         auto& ent = getent(i);
-        _is->seekg(ent.recofs);
-        auto s = makehelper(_is);
-        int klen = s.get16le();
-        _is->seekg(klen, std::ios_base::cur);
-        int vlen = s.get16le();
+        int klen = getle<2>(ent.recofs);
+        int vlen = getle<2>(ent.recofs+2+klen);
 
         dbgprint("%04x: val(%d), kl=%d, vl=%d\n", ent.recofs, i, klen, vlen);
-        return s.getdata(vlen);
+        return std::string(pagedata(ent.recofs+4+klen, vlen), vlen);
     }
 
     Entry& getent(int i) {
@@ -712,10 +1021,10 @@ public:
 
     // search for the key in this page.
     // getkey(index) ... act ... key
-    result find(const std::string& key)
+    result find(std::string_view key)
     {
-        //auto i = std::upper_bound(begin(), end(), key, [](const std::string& key, const Entry& ent){  return false; });
-        auto i = std::upper_bound(IntIter(0), IntIter(_count), key, [this](const std::string& key, int ix){  return key < this->getkey(ix); });
+        // compare against views on the page data, so the search does not copy keys.
+        auto i = std::upper_bound(IntIter(0), IntIter(_count), key, [this](std::string_view key, int ix){  return key < this->keyref(ix); });
 
         if (i==IntIter(0)) {
             if (isindex())
@@ -724,7 +1033,7 @@ public:
         }
         --i;
         int ix = i-IntIter(0);
-        if (getkey(ix) == key)
+        if (keyref(ix) == key)
             return {REL_EQUAL, ix};
         if (isindex())
             return {REL_RECURSE, ix};
@@ -743,6 +1052,13 @@ protected:
     uint32_t _firstfree;
     uint32_t _reccount;
     uint32_t _pagecount;
+
+    // the most recently used pages, the front is the newest.
+    std::list<Page_ptr> _cachelru;
+    std::unordered_map<uint32_t, std::list<Page_ptr>::iterator> _cachemap;
+    size_t _cachesize = 0;
+
+    int _indexlevels = -1;  // nr of index levels above the leaves, see `indexlevels`
 public:
     class Cursor {
         BtreeBase *_bt;
@@ -781,6 +1097,7 @@ public:
         {
             if (eof())
                 throw "cursor:EOF";
+            IDB_STAT_INC(cursorsteps);
             auto ent = _stack.back(); _stack.pop_back();
             if (ent.page->isleaf()) {
                 // from leaf move towards root
@@ -810,6 +1127,7 @@ public:
         {
             if (eof())
                 throw "cursor:EOF";
+            IDB_STAT_INC(cursorsteps);
             auto ent = _stack.back(); _stack.pop_back();
             ent.index--;
             if (ent.page->isleaf()) {
@@ -854,6 +1172,38 @@ public:
             auto ent = _stack.back();
             return ent.page->getval(ent.index);
         }
+        // same as getkey/getval, but return nullopt at EOF instead of throwing.
+        std::optional<std::string> trygetkey() const
+        {
+            if (eof())
+                return std::nullopt;
+            auto& ent = _stack.back();
+            return ent.page->getkey(ent.index);
+        }
+        std::optional<std::string> trygetval() const
+        {
+            if (eof())
+                return std::nullopt;
+            auto& ent = _stack.back();
+            return ent.page->getval(ent.index);
+        }
+
+        // views on the key/value at the cursor pos,
+        // only valid until the cursor is moved.
+        std::string_view getkeyref() const
+        {
+            if (eof())
+                throw "cursor:EOF";
+            auto& ent = _stack.back();
+            return ent.page->keyref(ent.index);
+        }
+        std::string_view getvalref() const
+        {
+            if (eof())
+                throw "cursor:EOF";
+            auto& ent = _stack.back();
+            return ent.page->valref(ent.index);
+        }
 
         bool operator==(const Cursor& rhs) const { return _stack == rhs._stack; }
         bool operator!=(const Cursor& rhs) const { return !(*this==rhs); }
@@ -869,10 +1219,38 @@ public:
     virtual void readheader() = 0;
     virtual Page_ptr  makepage(int nr) = 0;
 
+    // keep up to `n` decoded pages in memory, 0 disables the cache.
+    void setcachesize(size_t n)
+    {
+        _cachesize = n;
+        while (_cachelru.size() > _cachesize) {
+            _cachemap.erase(_cachelru.back()->nr());
+            _cachelru.pop_back();
+        }
+    }
+
     Page_ptr readpage(int nr)
     {
+        if (_cachesize) {
+            auto i = _cachemap.find(nr);
+            if (i != _cachemap.end()) {
+                IDB_STAT_INC(pagecachehits);
+                _cachelru.splice(_cachelru.begin(), _cachelru, i->second);
+                return _cachelru.front();
+            }
+        }
+        IDB_STAT_INC(pagesread);
+        IDB_STAT_PAGEREAD(nr);
         auto page = makepage(nr);
         page->readindex();
+        if (_cachesize) {
+            _cachelru.push_front(page);
+            _cachemap[nr] = _cachelru.begin();
+            if (_cachelru.size() > _cachesize) {
+                _cachemap.erase(_cachelru.back()->nr());
+                _cachelru.pop_back();
+            }
+        }
         return page;
     }
 
@@ -895,13 +1273,142 @@ public:
         }
     }
 
+    // returns the keys from the index pages with lo < key < hi, in ascending order.
+    // an empty `hi` means no upper bound.
+    //
+    // Starts at the root page, and goes down one level at a time, until at
+    // least `n` keys are found, or the next level has the leaf pages.
+    // Leaf pages are not read.
+    std::vector<std::string> separators(std::string_view lo, std::string_view hi, size_t n)
+    {
+        std::vector<std::string> keys;
+        std::vector<uint32_t> level { _firstindex };
+        while (true) {
+            keys.clear();
+            std::vector<uint32_t> children;
+            for (auto nr : level) {
+                auto page = readpage(nr);
+                if (page->isleaf())
+                    return keys;
+                int count = page->indexsize();
+                // child i has the keys between key i and key i+1, child -1 the keys before key 0.
+                for (int i=-1 ; i<count ; i++) {
+                    bool abovelo = i+1==count || page->keyref(i+1) > lo;
+                    bool belowhi = i<0 || hi.empty() || page->keyref(i) < hi;
+                    if (abovelo && belowhi)
+                        children.push_back(page->getpage(i));
+                    if (i>=0 && page->keyref(i) > lo && belowhi)
+                        keys.emplace_back(page->keyref(i));
+                }
+            }
+            if (keys.size() >= n || children.empty() || readpage(children.front())->isleaf())
+                return keys;
+            level.swap(children);
+        }
+    }
+
+    // the number of index levels above the leaf pages, 0 when the root is a leaf.
+    // The b-tree is balanced, so this is found once, by following the first children down,
+    // which reads one leaf page.
+    int indexlevels()
+    {
+        if (_indexlevels < 0) {
+            int levels = 0;
+            auto page = readpage(_firstindex);
+            while (page->isindex()) {
+                levels++;
+                page = readpage(page->getpage(-1));
+            }
+            _indexlevels = levels;
+        }
+        return _indexlevels;
+    }
+
+    struct estimate_t {
+        uint64_t records;  // estimated nr of records
+        uint64_t pages;    // nr of leaf pages with keys in the range
+    };
+
+    // estimates the nr of records with lo <= key < hi, reading at most one leaf page.
+    // an empty `hi` means no upper bound.
+    //
+    // Goes down the index levels like `separators`, reading only the index pages
+    // that overlap the range: about one page for every fanout leaves.
+    // The records in the index pages are counted, the leaves below the last index
+    // level are counted, and multiplied by the average nr of records per page
+    // from the header `_reccount`/`_pagecount`. The leaves with lo and hi are
+    // counted as half full.
+    //
+    // A range within a single leaf is counted exactly, from that leaf.
+    //
+    // The estimate is off by the difference between the record density in the
+    // range and the average.
+    estimate_t estimate(std::string_view lo, std::string_view hi)
+    {
+        if (!hi.empty() && hi <= lo)
+            return { 0, 0 };
+
+        auto inrange = [&](std::string_view key) { return lo <= key && (hi.empty() || key < hi); };
+        if (indexlevels() == 0) {
+            // a single page b-tree: count the keys.
+            auto page = readpage(_firstindex);
+            uint64_t count = 0;
+            for (unsigned i=0 ; i<page->indexsize() ; i++)
+                if (inrange(page->keyref(i)))
+                    count++;
+            return { count, 1 };
+        }
+
+        uint64_t indexrecords = 0;
+        std::vector<uint32_t> level { _firstindex };
+        for (int depth=0 ; depth<indexlevels() ; depth++) {
+            std::vector<uint32_t> children;
+            for (auto nr : level) {
+                auto page = readpage(nr);
+                int count = page->indexsize();
+                // child i has the keys between key i and key i+1, child -1 the keys before key 0.
+                for (int i=-1 ; i<count ; i++) {
+                    bool abovelo = i+1==count || page->keyref(i+1) > lo;
+                    bool belowhi = i<0 || hi.empty() || page->keyref(i) < hi;
+                    if (abovelo && belowhi)
+                        children.push_back(page->getpage(i));
+                    if (i>=0 && inrange(page->keyref(i)))
+                        indexrecords++;
+                }
+            }
+            level.swap(children);
+        }
+
+        // `level` now has the leaves overlapping the range.
+        if (level.size()==1) {
+            auto page = readpage(level[0]);
+            for (unsigned i=0 ; i<page->indexsize() ; i++)
+                if (inrange(page->keyref(i)))
+                    indexrecords++;
+            return { indexrecords, 1 };
+        }
+        double leaves = level.size();
+        if (!lo.empty())
+            leaves -= 0.5;
+        if (!hi.empty())
+            leaves -= 0.5;
+        double perpage = _pagecount ? double(_reccount)/_pagecount : 0;
+        double records = indexrecords + std::max(0.0, leaves) * perpage;
+
+        return { std::min(uint64_t(records + 0.5), uint64_t(_reccount)), level.size() };
+    }
+
+    // positions the section stream at page `nr`, the page is read directly from it.
     stream_ptr pagestream(int nr)
     {
-        return std::make_shared<sectionstream>(_is, nr*_pagesize, _pagesize);
+        _is->clear();
+        _is->seekg(uint64_t(nr)*_pagesize);
+        return _is;
     }
 
-    Cursor find(relation_t rel, const std::string& key)
+    Cursor find(relation_t rel, std::string_view key)
     {
+        IDB_STAT_INC(finds[rel]);
         auto page = readpage(_firstindex);
 
         Cursor cursor(this);
@@ -956,30 +1463,12 @@ public:
     Page15(stream_ptr  is, uint32_t nr, int pagesize)
         : BasePage(is, nr, pagesize)
     {
-        auto s = makehelper(_is);
-        _preceeding = s.get16le();
-        _count = s.get16le();
+        decodeheader<PageLayout15>();
     }
 
-    virtual Entry readent()
+    virtual void decodeindex()
     {
-        auto s = makehelper(_is);
-        if (isindex()) {
-            Entry ent;
-            ent.pagenr = s.get16le();
-            ent.recofs = s.get16le()+1;
-            dbgprint("@%04x: ix ent15 %08x %04x\n", (int)_is->tellg(), ent.pagenr, ent.recofs);
-            return ent;
-        }
-        else if (isleaf()) {
-            Entry ent;
-            ent.indent = s.get8();
-            /*ent.unknown = */s.get8();
-            ent.recofs = s.get16le()+1;
-            dbgprint("@%04x: lf ent15 %+4d %04x\n", (int)_is->tellg(), ent.indent, ent.recofs);
-            return ent;
-        }
-        throw "page not a index or leaf";
+        decodeentries<PageLayout15>();
     }
 };
 
@@ -1011,30 +1500,11 @@ public:
     Page16(stream_ptr  is, uint32_t nr, int pagesize)
         : BasePage(is, nr, pagesize)
     {
-        auto s = makehelper(_is);
-        _preceeding = s.get32le();
-        _count = s.get16le();
+        decodeheader<PageLayout16>();
     }
-    virtual Entry readent()
+    virtual void decodeindex()
     {
-        auto s = makehelper(_is);
-        if (isindex()) {
-            Entry ent;
-            ent.pagenr = s.get32le();
-            ent.recofs = s.get16le()+1;
-            dbgprint("@%04x: ix ent16 %08x %04x\n", (int)_is->tellg(), ent.pagenr, ent.recofs);
-            return ent;
-        }
-        else if (isleaf()) {
-            Entry ent;
-            ent.indent = s.get8();
-            /*ent.unknown = */s.get8();
-            /*ent.unknown1 = */s.get16le();
-            ent.recofs = s.get16le()+1;
-            dbgprint("@%04x: lf ent16 %+4d %04x\n", (int)_is->tellg(), ent.indent, ent.recofs);
-            return ent;
-        }
-        throw "page not a index or leaf";
+        decodeentries<PageLayout16>();
     }
 
 };
@@ -1068,26 +1538,9 @@ public:
         : Page16(is, nr, pagesize)
     {
     }
-    virtual Entry readent()
+    virtual void decodeindex()
     {
-        auto s = makehelper(_is);
-        if (isindex()) {
-            Entry ent;
-            ent.pagenr = s.get32le();
-            ent.recofs = s.get16le();
-            dbgprint("@%04x: ix ent20 %08x %04x\n", (int)_is->tellg(), ent.pagenr, ent.recofs);
-            return ent;
-        }
-        else if (isleaf()) {
-            Entry ent;
-            ent.indent = s.get16le();
-            /*ent.unknown = */s.get16le();
-            ent.recofs = s.get16le();
-
-            dbgprint("@%04x: lf ent20 %+4d %04x\n", (int)_is->tellg(), ent.indent, ent.recofs);
-            return ent;
-        }
-        throw "page not a index or leaf";
+        decodeentries<PageLayout20>();
     }
 
 };
@@ -1131,48 +1584,78 @@ inline std::unique_ptr<BtreeBase> MakeBTree(stream_ptr  is)
     return bt;
 }
 
-// NodeKeys is used to create btree keys with the right format
-// for the current database.
-class NodeKeys {
-    int _w;
+// a key of at most MAXSIZE bytes, stored inline.
+// Building a key for a lookup in an InlineKey does not allocate.
+class InlineKey {
 public:
-    NodeKeys(int wordsize)
-        : _w(wordsize)
+    enum { MAXSIZE = 512 };
+private:
+    uint32_t _size = 0;
+    char _data[MAXSIZE];
+public:
+    InlineKey() { }
+    InlineKey(const char *first, const char *last)
     {
+        resize(last-first);
+        std::copy(first, last, _data);
     }
+    void resize(size_t n)
+    {
+        if (n > MAXSIZE)
+            throw "key too large";
+        _size = n;
+    }
+    size_t size() const { return _size; }
+    const char *data() const { return _data; }
+    char& operator[](size_t i) { return _data[i]; }
+
+    std::string_view view() const { return std::string_view(_data, _size); }
+    operator std::string_view() const { return view(); }
+    std::string str() const { return std::string(_data, _size); }
+};
 
+// builds node and name keys for databases with `W` byte words.
+//
+// The word size is a template argument, so the key layout is known at
+// compile time, and fixed size keys are built in a local buffer.
+// Use NodeKeys when the word size is only known at runtime.
+template<int W>
+class WordKeys {
+    static_assert(W==4 || W==8, "unsupported wordsize");
+public:
+    enum { WORDSIZE = W };
 
     template<typename P>
-    void setwordle(P first, P last, uint64_t w)
+    static void setwordle(P first, P last, uint64_t w)
     {
-        if (_w==8)
+        if constexpr (W==8)
             EndianTools::setle64(first, last, w);
-        else if (_w==4)
+        else
             EndianTools::setle32(first, last, w);
     }
     template<typename P>
-    void setwordbe(P first, P last, uint64_t w)
+    static void setwordbe(P first, P last, uint64_t w)
     {
-        if (_w==8)
+        if constexpr (W==8)
             EndianTools::setbe64(first, last, w);
-        else if (_w==4)
+        else
             EndianTools::setbe32(first, last, w);
     }
     template<typename P>
-    int make_name_key(P first, P last, uint64_t id)
+    static int make_name_key(P first, P last, uint64_t id)
     {
-        if (last-first<1+_w)
+        if (last-first<1+W)
             throw "not enough space";
         P p = first;
         *p++ = 'N';
-        setwordbe(p, last, id); p += _w;
+        setwordbe(p, last, id); p += W;
 
         return p-first;
     }
     template<typename P>
-    int make_name_key(P first, P last, const std::string& name)
+    static int make_name_key(P first, P last, const std::string& name)
     {
-        if (last-first<1+name.size())
+        if (size_t(last-first)<1+name.size())
             throw "not enough space";
         P p = first;
         *p++ = 'N';
@@ -1183,35 +1666,35 @@ public:
     }
 
     template<typename P>
-    int make_node_key(P first, P last, uint64_t nodeid)
+    static int make_node_key(P first, P last, uint64_t nodeid)
     {
-        if (last-first<1+_w)
+        if (last-first<1+W)
             throw "not enough space";
         P p = first;
         *p++ = '.';
-        setwordbe(p, last, nodeid); p += _w;
+        setwordbe(p, last, nodeid); p += W;
 
         return p-first;
     }
     template<typename P>
-    int make_node_key(P first, P last, uint64_t nodeid, char tag)
+    static int make_node_key(P first, P last, uint64_t nodeid, char tag)
     {
-        if (last-first<2+_w)
+        if (last-first<2+W)
             throw "not enough space";
         P p = first;
         *p++ = '.';
-        setwordbe(p, last, nodeid); p += _w;
+        setwordbe(p, last, nodeid); p += W;
         *p++ = tag;
         return p-first;
     }
     template<typename P>
-    int make_node_key(P first, P last, uint64_t nodeid, char tag, const std::string& hashkey)
+    static int make_node_key(P first, P last, uint64_t nodeid, char tag, const std::string& hashkey)
     {
-        if (last-first<2+_w+hashkey.size())
+        if (size_t(last-first)<2+W+hashkey.size())
             throw "not enough space";
         P p = first;
         *p++ = '.';
-        setwordbe(p, last, nodeid); p += _w;
+        setwordbe(p, last, nodeid); p += W;
         *p++ = tag;  // usually 'H'
         std::copy(hashkey.begin(), hashkey.end(), p);
         p += hashkey.size();
@@ -1219,132 +1702,379 @@ public:
         return p-first;
     }
     template<typename P, typename T>
-    int make_node_key(P first, P last, uint64_t nodeid, char tag, T index)
+    static int make_node_key(P first, P last, uint64_t nodeid, char tag, T index)
     {
-        if (last-first<2+2*_w)
+        if (last-first<2+2*W)
             throw "not enough space";
         P p = first;
         *p++ = '.';
-        setwordbe(p, last, nodeid); p += _w;
+        setwordbe(p, last, nodeid); p += W;
         *p++ = tag;
-        setwordbe(p, last, index); p += _w;
+        setwordbe(p, last, index); p += W;
 
         return p-first;
     }
 
     template<typename V>
-    V make_name_key(uint64_t id)
+    static V make_name_key(uint64_t id)
     {
-        V key;
-        make_name_key(back_inserter(key), back_inserter(key), id);
-        return key;
+        char buf[1+W];
+        return V(buf, buf+make_name_key(buf, buf+sizeof(buf), id));
     }
     template<typename V>
-    V make_name_key(const std::string& name)
+    static V make_name_key(const std::string& name)
     {
         V key;
-        make_name_key(back_inserter(key), back_inserter(key), name);
+        key.resize(1+name.size());
+        make_name_key(&key[0], &key[0]+key.size(), name);
         return key;
     }
 
     template<typename V>
-    V make_node_key(uint64_t nodeid)
+    static V make_node_key(uint64_t nodeid)
     {
-        V key;
-        make_node_key(back_inserter(key), back_inserter(key), nodeid);
-        return key;
+        char buf[1+W];
+        return V(buf, buf+make_node_key(buf, buf+sizeof(buf), nodeid));
     }
     template<typename V>
-    V make_node_key(uint64_t nodeid, char tag)
+    static V make_node_key(uint64_t nodeid, char tag)
     {
-        V key;
-        make_node_key(back_inserter(key), back_inserter(key), nodeid, tag);
-        return key;
+        char buf[2+W];
+        return V(buf, buf+make_node_key(buf, buf+sizeof(buf), nodeid, tag));
     }
     template<typename V>
-    V make_node_key(uint64_t nodeid, char tag, const std::string& hashkey)
+    static V make_node_key(uint64_t nodeid, char tag, const std::string& hashkey)
     {
         V key;
-        make_node_key(back_inserter(key), back_inserter(key), nodeid, tag, hashkey);
+        key.resize(2+W+hashkey.size());
+        make_node_key(&key[0], &key[0]+key.size(), nodeid, tag, hashkey);
         return key;
     }
     template<typename V, typename T>
-    V make_node_key(uint64_t nodeid, char tag, T index)
+    static V make_node_key(uint64_t nodeid, char tag, T index)
     {
-        V key;
-        make_node_key(back_inserter(key), back_inserter(key), nodeid, tag, index);
-        return key;
+        char buf[2+2*W];
+        return V(buf, buf+make_node_key(buf, buf+sizeof(buf), nodeid, tag, index));
     }
 };
 
-// convert node values to integer or string.
-struct NodeValues {
-    static uint64_t getuint(const std::string& str)
-    {
-        switch(str.size()) {
-            case 1:
-                return EndianTools::get8(str.begin(), str.end());
-            case 2:
-                return EndianTools::getle16(str.begin(), str.end());
-            case 4:
-                return EndianTools::getle32(str.begin(), str.end());
-            case 8:
-                return EndianTools::getle64(str.begin(), str.end());
+// calls `fn` with std::integral_constant<int, 4> or <int, 8>,
+// so `fn` is compiled separately for each word size.
+template<typename FN>
+decltype(auto) withwordsize(int wordsize, FN fn)
+{
+    if (wordsize==8)
+        return fn(std::integral_constant<int, 8>());
+    if (wordsize==4)
+        return fn(std::integral_constant<int, 4>());
+    throw "unsupported wordsize";
+}
 
-        }
-        throw "unsupported int type";
+// the key construction of WordKeys<W>, behind a virtual interface,
+// for code where the word size is only known at runtime.
+// use `keybuilder(wordsize)` to get the implementation for a word size.
+class KeyBuilder {
+public:
+    virtual ~KeyBuilder() { }
+    virtual int wordsize() const = 0;
+
+    virtual void setwordle(char *first, char *last, uint64_t w) const = 0;
+    virtual void setwordbe(char *first, char *last, uint64_t w) const = 0;
+
+    // these return the key size, like the WordKeys functions.
+    virtual int make_name_key(char *first, char *last, uint64_t id) const = 0;
+    virtual int make_name_key(char *first, char *last, const std::string& name) const = 0;
+    virtual int make_node_key(char *first, char *last, uint64_t nodeid) const = 0;
+    virtual int make_node_key(char *first, char *last, uint64_t nodeid, char tag) const = 0;
+    virtual int make_node_key(char *first, char *last, uint64_t nodeid, char tag, const std::string& hashkey) const = 0;
+    virtual int make_node_key(char *first, char *last, uint64_t nodeid, char tag, uint64_t index) const = 0;
+};
+
+template<int W>
+class WordKeyBuilder : public KeyBuilder {
+    typedef WordKeys<W> keys;
+public:
+    int wordsize() const override { return W; }
+
+    void setwordle(char *first, char *last, uint64_t w) const override { keys::setwordle(first, last, w); }
+    void setwordbe(char *first, char *last, uint64_t w) const override { keys::setwordbe(first, last, w); }
+
+    int make_name_key(char *first, char *last, uint64_t id) const override
+    {
+        return keys::make_name_key(first, last, id);
     }
-    static uint64_t getuintbe(const std::string& str)
+    int make_name_key(char *first, char *last, const std::string& name) const override
     {
-        switch(str.size()) {
-            case 1:
-                return EndianTools::get8(str.begin(), str.end());
-            case 2:
-                return EndianTools::getbe16(str.begin(), str.end());
-            case 4:
-                return EndianTools::getbe32(str.begin(), str.end());
-            case 8:
-                return EndianTools::getbe64(str.begin(), str.end());
-
-        }
-        throw "unsupported int type";
+        return keys::make_name_key(first, last, name);
     }
-    static int64_t getint(const std::string& str)
+    int make_node_key(char *first, char *last, uint64_t nodeid) const override
     {
-        return (int64_t)getuint(str);
+        return keys::make_node_key(first, last, nodeid);
     }
-    static std::string getstr(std::string data)
+    int make_node_key(char *first, char *last, uint64_t nodeid, char tag) const override
     {
-        // strip terminating zeroes
-        while (!data.empty() && data.back()==0)
-            data.pop_back();
-        return data;
+        return keys::make_node_key(first, last, nodeid, tag);
+    }
+    int make_node_key(char *first, char *last, uint64_t nodeid, char tag, const std::string& hashkey) const override
+    {
+        return keys::make_node_key(first, last, nodeid, tag, hashkey);
+    }
+    int make_node_key(char *first, char *last, uint64_t nodeid, char tag, uint64_t index) const override
+    {
+        return keys::make_node_key(first, last, nodeid, tag, index);
     }
 };
 
-// provide access to the main part of the IDApro database.
-//
-// use 'find', 'node' and 'blob' to access nodes in the database.
-class ID0File {
-    std::unique_ptr<BtreeBase> _bt;
-    uint64_t _nodebase;
+inline const KeyBuilder& keybuilder(int wordsize)
+{
+    static const WordKeyBuilder<4> keys4;
+    static const WordKeyBuilder<8> keys8;
+    if (wordsize==8)
+        return keys8;
+    if (wordsize==4)
+        return keys4;
+    throw "unsupported wordsize";
+}
+
+// NodeKeys is used to create btree keys with the right format
+// for the current database, when the word size is only known at runtime.
+// The KeyBuilder for the word size is selected once, in the constructor.
+class NodeKeys {
+    const KeyBuilder *_kb;
+
+    // the largest fixed size key: .<nodeid><tag><index>
+    enum { MAXFIXEDKEY = 2+2*8 };
+public:
+    NodeKeys(int wordsize)
+        : _kb(&keybuilder(wordsize))
+    {
+    }
+    int wordsize() const { return _kb->wordsize(); }
+
+    template<typename P>
+    void setwordle(P first, P last, uint64_t w) const
+    {
+        _kb->setwordle(&*first, &*first+(last-first), w);
+    }
+    template<typename P>
+    void setwordbe(P first, P last, uint64_t w) const
+    {
+        _kb->setwordbe(&*first, &*first+(last-first), w);
+    }
+
+    template<typename V>
+    V make_name_key(uint64_t id) const
+    {
+        char buf[MAXFIXEDKEY];
+        return V(buf, buf+_kb->make_name_key(buf, buf+sizeof(buf), id));
+    }
+    template<typename V>
+    V make_name_key(const std::string& name) const
+    {
+        V key;
+        key.resize(1+name.size());
+        _kb->make_name_key(&key[0], &key[0]+key.size(), name);
+        return key;
+    }
+    template<typename V>
+    V make_node_key(uint64_t nodeid) const
+    {
+        char buf[MAXFIXEDKEY];
+        return V(buf, buf+_kb->make_node_key(buf, buf+sizeof(buf), nodeid));
+    }
+    template<typename V>
+    V make_node_key(uint64_t nodeid, char tag) const
+    {
+        char buf[MAXFIXEDKEY];
+        return V(buf, buf+_kb->make_node_key(buf, buf+sizeof(buf), nodeid, tag));
+    }
+    template<typename V>
+    V make_node_key(uint64_t nodeid, char tag, const std::string& hashkey) const
+    {
+        V key;
+        key.resize(2+wordsize()+hashkey.size());
+        _kb->make_node_key(&key[0], &key[0]+key.size(), nodeid, tag, hashkey);
+        return key;
+    }
+    template<typename V>
+    V make_node_key(uint64_t nodeid, char tag, uint64_t index) const
+    {
+        char buf[MAXFIXEDKEY];
+        return V(buf, buf+_kb->make_node_key(buf, buf+sizeof(buf), nodeid, tag, index));
+    }
+};
+
+// decodes a key created by NodeKeys, without copying the key data.
+//
+//   .<nodeid>                     kind '.'
+//   .<nodeid><tag>
+//   .<nodeid><tag><index>         hasindex()
+//   .<nodeid><tag><hashkey>       hashkey() is not empty
+//   N<name>                       kind 'N'
+//   $ <name>                      kind '$', like '$ MAX NODE'
+//
+// nodeid and index are big endian words of `wordsize` bytes.
+// A hashkey of exactly `wordsize` bytes has the same layout as an index,
+// the key is only decoded as a hashkey for the hash tag 'H'; with other
+// tags such a key decodes as an index.
+// the view is only valid as long as the key data it refers to.
+class KeyView {
+public:
+    enum { HASHTAG = 'H' };
+private:
+    std::string_view _key;
+    uint64_t _nodeid;
+    uint64_t _index;
+    uint8_t _w;
+    char _tag;
+    bool _hasindex;
+
+    template<int W>
+    uint64_t getwordbe(int ofs) const
+    {
+        auto p = (const uint8_t*)_key.data() + ofs;
+        if constexpr (W==8)
+            return EndianTools::getbe64(p, p+8);
+        else
+            return EndianTools::getbe32(p, p+4);
+    }
+    template<int W>
+    void decode()
+    {
+        if (!isnode())
+            return;
+        _nodeid = getwordbe<W>(1);
+        if (_key.size() > 1+W)
+            _tag = _key[1+W];
+        if (_key.size() == 2+2*W && _tag != HASHTAG) {
+            _index = getwordbe<W>(2+W);
+            _hasindex = true;
+        }
+    }
+public:
+    KeyView(std::string_view key, int wordsize)
+        : _key(key), _nodeid(0), _index(0), _w(wordsize), _tag(0), _hasindex(false)
+    {
+        withwordsize(wordsize, [this](auto ws) { decode<decltype(ws)::value>(); });
+    }
+    // decodes with the word size fixed at compile time.
+    template<int W>
+    KeyView(std::string_view key, std::integral_constant<int, W>)
+        : _key(key), _nodeid(0), _index(0), _w(W), _tag(0), _hasindex(false)
+    {
+        decode<W>();
+    }
+    std::string_view data() const { return _key; }
+    char kind() const { return _key.empty() ? 0 : _key[0]; }
+
+    bool isnode() const { return kind()=='.' && _key.size() >= 1+size_t(_w); }
+    bool isname() const { return kind()=='N'; }
+
+    uint64_t nodeid() const { return _nodeid; }
+    // returns 0 for keys without a tag.
+    char tag() const { return _tag; }
+    bool hasindex() const { return _hasindex; }
+    uint64_t index() const { return _index; }
+    // the string following the tag, for keys without a word index.
+    std::string_view hashkey() const
+    {
+        if (!isnode() || _hasindex || _key.size() <= 2+size_t(_w))
+            return {};
+        return _key.substr(2+_w);
+    }
+    // the name of 'N' keys
+    std::string_view name() const
+    {
+        if (!isname())
+            return {};
+        return _key.substr(1);
+    }
+};
+
+// convert node values to integer or string.
+struct NodeValues {
+    // returns nullopt for values which are not 1, 2, 4 or 8 bytes.
+    static std::optional<uint64_t> trygetuint(std::string_view str)
+    {
+        switch(str.size()) {
+            case 1:
+                return EndianTools::get8(str.begin(), str.end());
+            case 2:
+                return EndianTools::getle16(str.begin(), str.end());
+            case 4:
+                return EndianTools::getle32(str.begin(), str.end());
+            case 8:
+                return EndianTools::getle64(str.begin(), str.end());
+
+        }
+        return std::nullopt;
+    }
+    static uint64_t getuint(std::string_view str)
+    {
+        auto value = trygetuint(str);
+        if (!value)
+            throw "unsupported int type";
+        return *value;
+    }
+    static uint64_t getuintbe(std::string_view str)
+    {
+        switch(str.size()) {
+            case 1:
+                return EndianTools::get8(str.begin(), str.end());
+            case 2:
+                return EndianTools::getbe16(str.begin(), str.end());
+            case 4:
+                return EndianTools::getbe32(str.begin(), str.end());
+            case 8:
+                return EndianTools::getbe64(str.begin(), str.end());
+
+        }
+        throw "unsupported int type";
+    }
+    static int64_t getint(std::string_view str)
+    {
+        return (int64_t)getuint(str);
+    }
+    static std::string getstr(std::string_view data)
+    {
+        // strip terminating zeroes
+        while (!data.empty() && data.back()==0)
+            data.remove_suffix(1);
+        return std::string(data);
+    }
+};
+
+// provide access to the main part of the IDApro database.
+//
+// use 'find', 'node' and 'blob' to access nodes in the database.
+class ID0File {
+    std::unique_ptr<BtreeBase> _bt;
     int _wordsize;
+    uint64_t _nodebase;
+    NodeKeys _keys;     // selected once for the word size, used for all key construction
 
 public:
     enum { INDEX = 0 };  // argument for idb.getsection()
 
     ID0File(IDBFile& idb, stream_ptr  is)
-        : _bt(MakeBTree(is))
+        : _bt(MakeBTree(is)),
+          _wordsize(idb.magic() == IDBFile::MAGIC_IDA2 ? 8 : 4),
+          _nodebase(uint64_t(0xFF)<<((_wordsize-1)*8)),
+          _keys(_wordsize)
     {
-        if (idb.magic() == IDBFile::MAGIC_IDA2)
-            _wordsize = 8;
-        else
-            _wordsize = 4;
-
-        _nodebase = uint64_t(0xFF)<<((_wordsize-1)*8);
     }
     uint64_t nodebase() const { return _nodebase; }
     bool is64bit() const { return _wordsize==8; }
+    int wordsize() const { return _wordsize; }
+    // calls `fn(std::integral_constant<int, W>())` with the word size of this database,
+    // use WordID0<W> inside `fn` to work with the word size fixed at compile time.
+    template<typename FN>
+    decltype(auto) withwordsize(FN fn) const
+    {
+        return ::withwordsize(_wordsize, fn);
+    }
+    // see BtreeBase::setcachesize
+    void setcachesize(size_t n) { _bt->setcachesize(n); }
     void dump()
     {
         _bt->dump();
@@ -1354,16 +2084,22 @@ public:
     template<typename...ARGS>
     std::string makekey(ARGS...args)
     {
-        NodeKeys nk(_wordsize);
-        return nk.make_node_key<std::string>(args...);
+        return _keys.make_node_key<std::string>(args...);
     }
 
     // function for creating a name key for the current database.
     template<typename...ARGS>
     std::string makename(ARGS...args)
     {
-        NodeKeys nk(_wordsize);
-        return nk.make_name_key<std::string>(args...);
+        return _keys.make_name_key<std::string>(args...);
+    }
+
+    // same as makekey, but the key is stored inline, without allocating.
+    // used for the lookups below.
+    template<typename...ARGS>
+    InlineKey inlinekey(ARGS...args)
+    {
+        return _keys.make_node_key<InlineKey>(args...);
     }
 
     // search for records in the current database by key.
@@ -1371,7 +2107,7 @@ public:
     // REL_LESS  : return records less than the key.
     //
     // returns a cursor object.
-    auto find(relation_t rel, const std::string& key)
+    auto find(relation_t rel, std::string_view key)
     {
         return _bt->find(rel, key);
     }
@@ -1384,18 +2120,83 @@ public:
     template<typename...ARGS>
     auto find(relation_t rel, uint64_t nodeid, ARGS...args)
     {
-        return _bt->find(rel, makekey(nodeid, args...));
+        return _bt->find(rel, inlinekey(nodeid, args...));
+    }
+
+    // returns the smallest key larger than all keys starting with `prefix`,
+    // or an empty string when there is no such key.
+    static std::string prefixend(std::string prefix)
+    {
+        while (!prefix.empty() && uint8_t(prefix.back())==0xFF)
+            prefix.pop_back();
+        if (!prefix.empty())
+            prefix.back()++;
+        return prefix;
+    }
+
+    // calls `cb(cursor)` for all records with  lo <= key < hi, in ascending order.
+    // an empty `hi` scans until the end of the database.
+    // the scan stops early when `cb` returns false.
+    template<typename CB>
+    void scan(const std::string& lo, const std::string& hi, CB cb)
+    {
+        auto c = _bt->find(REL_GREATER_EQUAL, lo);
+        while (!c.eof() && (hi.empty() || c.getkeyref() < hi)) {
+            if (!cb(c))
+                break;
+            c.next();
+        }
+    }
+    // same as scan, but in descending order.
+    template<typename CB>
+    void rscan(const std::string& lo, const std::string& hi, CB cb)
+    {
+        auto c = hi.empty() ? _bt->find(REL_LESS_EQUAL, "\xFF\xFF\xFF\xFF")
+                            : _bt->find(REL_LESS, hi);
+        while (!c.eof() && c.getkeyref() >= lo) {
+            if (!cb(c))
+                break;
+            c.prev();
+        }
+    }
+
+    // splits [lo, hi) in at most `n` consecutive ranges, using keys from the index pages
+    // as the boundaries. The subtrees below an index level have about the same number
+    // of pages, so the ranges hold about the same amount of data.
+    // an empty `hi` means no upper bound, like for scan.
+    // Fewer ranges are returned when the index has not enough keys in the range.
+    std::vector<std::pair<std::string, std::string>> partition(const std::string& lo, const std::string& hi, size_t n)
+    {
+        std::vector<std::pair<std::string, std::string>> parts;
+        auto keys = _bt->separators(lo, hi, n);
+        std::string start = lo;
+        for (size_t i=1 ; i<n && !keys.empty() ; i++) {
+            auto& key = keys[i*keys.size()/n];
+            if (key <= start)
+                continue;
+            parts.emplace_back(start, key);
+            start = key;
+        }
+        parts.emplace_back(start, hi);
+        return parts;
+    }
+
+    // estimates the nr of records in [lo, hi), without reading leaf pages,
+    // see BtreeBase::estimate.
+    BtreeBase::estimate_t estimate(std::string_view lo, std::string_view hi)
+    {
+        return _bt->estimate(lo, hi);
     }
 
     // return a blob object as a string.
     std::string blob(uint64_t nodeid, char tag, uint64_t startid = 0, uint64_t lastid = 0xFFFFFFFF)
     {
-        auto c = _bt->find(REL_GREATER_EQUAL, makekey(nodeid, tag, startid));
-        auto endkey =  makekey(nodeid, tag, lastid);
+        auto c = _bt->find(REL_GREATER_EQUAL, inlinekey(nodeid, tag, startid));
+        auto endkey =  inlinekey(nodeid, tag, lastid);
 
         std::string blob;
-        while (c.getkey() <= endkey) {
-            blob += c.getval();
+        while (!c.eof() && c.getkeyref() <= endkey.view()) {
+            blob += c.getvalref();
             c.next();
         }
 
@@ -1407,10 +2208,13 @@ public:
     // names can be labels like 'sub_1234', but also internal names like '$ structs', or 'Root Name'
     uint64_t node(const std::string& name)
     {
-        auto c = _bt->find(REL_EQUAL, makename(name));
+        // longer keys can't be in the database.
+        if (1+name.size() > InlineKey::MAXSIZE)
+            return 0;
+        auto c = _bt->find(REL_EQUAL, _keys.make_name_key<InlineKey>(name));
         if (c.eof())
             return 0;
-        return NodeValues::getint(c.getval());
+        return NodeValues::getint(c.getvalref());
     }
 
     // callback is called for each nodeid in the list.
@@ -1418,10 +2222,39 @@ public:
     template<typename CB>
     void enumlist(uint64_t nodeid, char tag, CB cb)
     {
-        auto c = _bt->find(REL_GREATER_EQUAL, makekey(nodeid, tag));
-        auto endkey = makekey(nodeid, tag+1);
-        while (c.getkey() <= endkey)
-            cb(NodeValues::getint(c.getval()));
+        auto c = _bt->find(REL_GREATER_EQUAL, inlinekey(nodeid, tag));
+        auto endkey = inlinekey(nodeid, tag+1);
+        while (!c.eof() && c.getkeyref() < endkey.view()) {
+            cb(NodeValues::getint(c.getvalref()));
+            c.next();
+        }
+    }
+
+    // non throwing interface: returns nullopt when the record is not found.
+    // for trygetuint also when the value is not a valid int.
+    template<typename...ARGS>
+    std::optional<BtreeBase::Cursor> tryfind(ARGS...args)
+    {
+        auto c = _bt->find(REL_EQUAL, inlinekey(args...));
+        if (c.eof())
+            return std::nullopt;
+        return c;
+    }
+    template<typename...ARGS>
+    std::optional<std::string> trygetdata(ARGS...args)
+    {
+        auto c = _bt->find(REL_EQUAL, inlinekey(args...));
+        if (c.eof())
+            return std::nullopt;
+        return c.getval();
+    }
+    template<typename...ARGS>
+    std::optional<uint64_t> trygetuint(ARGS...args)
+    {
+        auto c = _bt->find(REL_EQUAL, inlinekey(args...));
+        if (c.eof())
+            return std::nullopt;
+        return NodeValues::trygetuint(c.getvalref());
     }
 
     // 'easy' interface: return empty when record not found.
@@ -1429,52 +2262,99 @@ public:
     template<typename...ARGS>
     std::string getdata(ARGS...args)
     {
-        auto c = find(REL_EQUAL, makekey(args...));
-        if (c.eof())
-            return {};
-        return c.getval();
+        return trygetdata(args...).value_or(std::string());
     }
     template<typename...ARGS>
     std::string getstr(ARGS...args)
     {
         // until ida6.7 strings were stored zero terminated.
-        auto c = find(REL_EQUAL, makekey(args...));
+        auto c = _bt->find(REL_EQUAL, inlinekey(args...));
         if (c.eof())
             return {};
-        return NodeValues::getstr(c.getval());
+        return NodeValues::getstr(c.getvalref());
     }
     template<typename...ARGS>
     uint64_t getuint(ARGS...args)
     {
-        auto c = find(REL_EQUAL, makekey(args...));
+        auto c = _bt->find(REL_EQUAL, inlinekey(args...));
         if (c.eof())
             return {};
-        return NodeValues::getuint(c.getval());
+        return NodeValues::getuint(c.getvalref());
     }
     uint64_t getuint(BtreeBase::Cursor& c)
     {
-        return NodeValues::getuint(c.getval());
+        return NodeValues::getuint(c.getvalref());
+    }
+
+    // decode the key at the cursor position,
+    // only valid until the cursor is moved.
+    KeyView keyview(const BtreeBase::Cursor& c) const
+    {
+        return KeyView(c.getkeyref(), _wordsize);
     }
 
     // returns the node name, resolves long names.
     std::string getname(uint64_t node)
     {
-        auto c = find(REL_EQUAL, makekey(node, 'N'));
+        auto c = _bt->find(REL_EQUAL, inlinekey(node, 'N'));
         if (c.eof())
             return {};
-        auto val = c.getval();
+        auto val = c.getvalref();
         if (val.empty())
             return {};
         if (val[0]==0) {
-            val.erase(val.begin());
             // bigname
-            uint64_t nameid = NodeValues::getuintbe(val);
-            val = blob(_nodebase, 'S', nameid*256, nameid*256+32);
+            uint64_t nameid = NodeValues::getuintbe(val.substr(1));
+            return NodeValues::getstr(blob(_nodebase, 'S', nameid*256, nameid*256+32));
         }
         return NodeValues::getstr(val);
     }
 };
 
+// scans the key ranges in `parts` with `nthreads` threads.
+//
+// Use ID0File::partition to split a range, in a few parts per thread,
+// so threads which finish early can take over the remaining parts.
+// An ID0File can't be shared between threads, so each thread opens its own
+// with `open()`, which returns a std::unique_ptr<ID0File>.
+// The threads take the parts in order, and call `cb(part, cursor)` for each record,
+// a part stops early when `cb` returns false.
+// `part` is the index in `parts`, so results collected per part can be
+// concatenated in key order.
+//
+// An exception in one of the threads is rethrown after all threads have finished.
+template<typename OPEN, typename CB>
+void parallelscan(const std::vector<std::pair<std::string, std::string>>& parts, OPEN open, int nthreads, CB cb)
+{
+    std::atomic<size_t> nextpart(0);
+    std::mutex errorlock;
+    std::exception_ptr error;
+    auto worker = [&]() {
+        try {
+            auto db = open();
+            size_t i;
+            while ((i = nextpart++) < parts.size())
+                db->scan(parts[i].first, parts[i].second, [&](BtreeBase::Cursor& c) { return cb(i, c); });
+        }
+        catch(...) {
+            std::lock_guard<std::mutex> lock(errorlock);
+            if (!error)
+                error = std::current_exception();
+            nextpart = parts.size();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t t=1 ; t<std::min<size_t>(nthreads, parts.size()) ; t++)
+        threads.emplace_back(worker);
+    worker();
+    for (auto& t : threads)
+        t.join();
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
 #ifndef BADADDR 
 #define BADADDR uint64_t(-1)
 #endif
@@ -1566,6 +2446,7 @@ public:
 
     uint32_t GetFlags(uint64_t ea) const
     {
+        IDB_STAT_INC(getflags);
         // for optimization maybe i need to implement some kind of flags page caching
         segmentlist_t::const_iterator i= find_segment(ea);
         if (i==_segments.end())
@@ -1608,17 +2489,66 @@ public:
     }
 };
 
+// returns the number of trailing zero bits in a non-zero value.
+inline int counttrailingzeros(uint64_t x)
+{
+#if defined(_MSC_VER)
+    unsigned long ix;
+    _BitScanForward64(&ix, x);
+    return ix;
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
 // NAMFile keeps a list of named items.
 class NAMFile {
 private:
     mutable std::vector<uint64_t> _namedoffsets;
     mutable bool _namesloaded;
 
+    // optional search index: the named offsets in eytzinger ( breadth first ) order,
+    // 1-based, so the children of item k are at 2k and 2k+1.
+    // This keeps the first levels of the search in a few cachelines.
+    std::vector<uint64_t> _eytzinger;
+
     stream_ptr _is;
     int _wordsize;
 
     uint32_t _nnames;
     uint64_t _listofs;
+
+    // copy the sorted list in-order into the eytzinger tree rooted at `k`.
+    size_t filleytzinger(size_t i, size_t k)
+    {
+        if (k < _eytzinger.size()) {
+            i = filleytzinger(i, 2*k);
+            _eytzinger[k] = _namedoffsets[i++];
+            i = filleytzinger(i, 2*k+1);
+        }
+        return i;
+    }
+    // branchless search for the last item <= ea.
+    uint64_t findeytzinger(uint64_t ea) const
+    {
+        const uint64_t *tree = &_eytzinger[0];
+        size_t n = _eytzinger.size();
+        size_t k = 1;
+        while (k < n) {
+#if defined(__GNUC__)
+            // the 16 descendants 4 levels down are stored consecutively,
+            // only form the pointer while it is inside the tree.
+            if (16*k < n)
+                __builtin_prefetch(tree + 16*k);
+#endif
+            k = 2*k + (tree[k] <= ea);
+        }
+        // the trailing zero bits are the left turns taken after the last
+        // step to the right, strip them to get the item we last went right at.
+        k >>= counttrailingzeros(k)+1;
+
+        return tree[k];
+    }
 public:
     enum { INDEX = 2 };  // argument for idb.getsection()
 
@@ -1683,8 +2613,11 @@ public:
 
         auto s = makehelper(_is, _wordsize);
         s.seekg(_listofs);
-        for (unsigned i=0 ; i<_nnames ; i++)
-            _namedoffsets.push_back(s.getword());
+        withwordsize(_wordsize, [&](auto ws) {
+            for (unsigned i=0 ; i<_nnames ; i++)
+                _namedoffsets.push_back(s.template getword<decltype(ws)::value>());
+        });
+        IDB_STAT_ADD(namesloaded, _nnames);
 
         _namesloaded = true;
     }
@@ -1699,12 +2632,28 @@ public:
         loadoffsets();
         std::for_each(_namedoffsets.begin(), _namedoffsets.end(), fn);
     }
+    // build the eytzinger search index, after this findname no longer
+    // uses a binary search over the sorted list.
+    void buildsearchindex()
+    {
+        loadoffsets();
+        _eytzinger.resize(_namedoffsets.size()+1);
+        // slot 0 is returned for addresses before the first name.
+        if (!_namedoffsets.empty())
+            _eytzinger[0] = _namedoffsets.front();
+        filleytzinger(0, 1);
+    }
+    bool hassearchindex() const { return !_eytzinger.empty(); }
+
     // finds nearest named item
     uint64_t findname(uint64_t ea) const
     {
+        IDB_STAT_INC(findname);
         loadoffsets();
         if (_namedoffsets.empty())
             return BADADDR;
+        if (hassearchindex())
+            return findeytzinger(ea);
         auto i= std::upper_bound(_namedoffsets.begin(), _namedoffsets.end(), ea);
         if (i==_namedoffsets.begin()) {
             // address before first: return first named item
@@ -1714,12 +2663,311 @@ public:
         return *i;
     }
 
+    // finds the nearest named item for each address in `eas`.
+    // When `eas` is sorted, this is a single merge pass over the list of names,
+    // otherwise each address is looked up separately.
+    std::vector<uint64_t> findnames(const std::vector<uint64_t>& eas) const
+    {
+        loadoffsets();
+        std::vector<uint64_t> result;
+        result.reserve(eas.size());
+        if (_namedoffsets.empty()) {
+            result.resize(eas.size(), BADADDR);
+            return result;
+        }
+        if (!std::is_sorted(eas.begin(), eas.end())) {
+            for (auto ea : eas)
+                result.push_back(findname(ea));
+            return result;
+        }
+
+        IDB_STAT_ADD(findname, eas.size());
+        size_t i = 0;
+        size_t n = _namedoffsets.size();
+        for (auto ea : eas) {
+            // gallop forward, so a few addresses spread over a large list stay cheap.
+            size_t step = 1;
+            while (i+step < n && _namedoffsets[i+step] <= ea)
+                step *= 2;
+            i = std::upper_bound(_namedoffsets.begin()+i, _namedoffsets.begin()+std::min(i+step, n), ea) - _namedoffsets.begin();
+
+            // address before first: return first named item
+            result.push_back(_namedoffsets[i ? i-1 : 0]);
+        }
+        return result;
+    }
+
     uint64_t firstnamed() const
     {
-        loadoffsets();
-        if (_namedoffsets.empty())
-            return BADADDR;
-        return *_namedoffsets.begin();
+        loadoffsets();
+        if (_namedoffsets.empty())
+            return BADADDR;
+        return *_namedoffsets.begin();
+    }
+};
+
+// TILFile reads the type library stored in the til section.
+//
+// The constructor only reads the header, and the position of each bucket.
+// The name index is built on the first lookup, in one pass over the bucket,
+// and entries are decoded only when requested.
+//
+// Layout, all integers little endian:
+//   char[6]  "IDATIL"
+//   uint32   format
+//   uint32   flags           TIL_xxx
+//   pascal   title, base     uint8 length + bytes
+//   uint8    id, cm, size_i, size_b, size_e, def_align
+//   uint8    size_s, size_l, size_ll   when TIL_ESI
+//   uint8    size_ldbl                 when TIL_SLD
+//   bucket   symbols
+//   uint32   nr of ordinals            when TIL_ORD
+//   bucket   types
+//   bucket   macros                    when TIL_MAC
+//
+// a bucket is: uint32 ndefs, uint32 size, [ uint32 csize when TIL_ZIP ], data
+//
+// symbol and type entries are:
+//   uint32 flags, name\0, [ uint32 ordinal, types only ], type\0, fields\0, cmt\0, fieldcmts\0, uint8 sclass
+class TILFile {
+public:
+    enum { INDEX = 4 };  // argument for idb.getsection()
+    enum {
+        TIL_ZIP = 0x0001,   // buckets are compressed
+        TIL_MAC = 0x0002,   // has a macro bucket
+        TIL_ESI = 0x0004,   // has the short, long, longlong sizes
+        TIL_UNI = 0x0008,   // universal til
+        TIL_ORD = 0x0010,   // has the ordinal count
+        TIL_ALI = 0x0020,   // type aliases
+        TIL_MOD = 0x0040,   // modified
+        TIL_STM = 0x0080,   // has extra type info
+        TIL_SLD = 0x0100,   // has the long double size
+    };
+    enum bucket_t { SYMBOLS, TYPES, MACROS };
+
+    struct Entry {
+        uint32_t flags = 0;
+        std::string name;
+        uint32_t ordinal = 0;
+        std::string type;           // the serialized type string
+        std::string fields;
+        std::string comment;
+        std::string fieldcomments;
+        uint8_t sclass = 0;
+    };
+private:
+    struct bucket {
+        uint32_t ndefs = 0;
+        uint32_t size = 0;
+        uint64_t dataofs = 0;
+        bool present = false;
+        bool indexed = false;
+        std::unordered_map<std::string, uint64_t> index;   // name -> entry offset
+    };
+    stream_ptr _is;
+    uint32_t _format;
+    uint32_t _flags;
+    uint32_t _nordinals;
+    std::string _title;
+    std::string _base;
+    uint8_t _cm;
+    mutable bucket _buckets[3];
+
+    template<typename S>
+    std::string getpascal(S& s)
+    {
+        return s.getdata(s.get8());
+    }
+    template<typename S>
+    void readbucket(S& s, bucket& b)
+    {
+        b.ndefs = s.get32le();
+        b.size = s.get32le();
+        uint32_t stored = b.size;
+        if (_flags & TIL_ZIP)
+            stored = s.get32le();
+        b.dataofs = _is->tellg();
+        b.present = true;
+        s.seekg(stored, std::ios_base::cur);
+    }
+    std::string getcstr() const
+    {
+        std::string str;
+        std::getline(*_is, str, '\0');
+        return str;
+    }
+    const bucket& getbucket(bucket_t bi) const
+    {
+        auto& b = _buckets[bi];
+        if (!b.present)
+            throw "til: no such bucket";
+        if (_flags & TIL_ZIP)
+            throw "til: compressed buckets not supported";
+        return b;
+    }
+    // one pass over the bucket, recording the offset of each name.
+    void buildindex(bucket_t bi) const
+    {
+        auto& b = _buckets[bi];
+        if (b.indexed)
+            return;
+        getbucket(bi);
+        if (bi == MACROS)
+            throw "til: macros are not indexed";
+
+        std::string data(b.size, char(0));
+        _is->seekg(b.dataofs);
+        _is->read(&data[0], data.size());
+
+        b.index.reserve(b.ndefs);
+        const char *p = data.data();
+        const char *end = p + data.size();
+        auto skipstr = [&]() {
+            auto q = (const char*)memchr(p, 0, end-p);
+            if (!q)
+                throw "til: unterminated string";
+            auto str = p;
+            p = q+1;
+            return std::string_view(str, q-str);
+        };
+        auto skip = [&](size_t n) {
+            if (size_t(end-p) < n)
+                throw "til: truncated entry";
+            p += n;
+        };
+        for (uint32_t i=0 ; i<b.ndefs ; i++) {
+            uint64_t ofs = b.dataofs + (p-data.data());
+            skip(4);
+            auto name = skipstr();
+            if (bi == TYPES)
+                skip(4);
+            for (int j=0 ; j<4 ; j++)
+                skipstr();
+            skip(1);
+            b.index.emplace(name, ofs);
+        }
+        b.indexed = true;
+    }
+public:
+    TILFile(stream_ptr is)
+        : _is(is), _format(0), _flags(0), _nordinals(0), _cm(0)
+    {
+        open();
+    }
+    void open()
+    {
+        auto s = makehelper(_is);
+        s.seekg(0);
+        if (s.getdata(6) != "IDATIL")
+            throw "invalid til";
+        _format = s.get32le();
+        _flags = s.get32le();
+        _title = getpascal(s);
+        _base = getpascal(s);
+        /*id = */ s.get8();
+        _cm = s.get8();
+        /*size_i, size_b, size_e, def_align = */ s.getdata(4);
+        if (_flags & TIL_ESI)
+            /*size_s, size_l, size_ll = */ s.getdata(3);
+        if (_flags & TIL_SLD)
+            /*size_ldbl = */ s.get8();
+
+        readbucket(s, _buckets[SYMBOLS]);
+        if (_flags & TIL_ORD)
+            _nordinals = s.get32le();
+        readbucket(s, _buckets[TYPES]);
+        if (_flags & TIL_MAC)
+            readbucket(s, _buckets[MACROS]);
+    }
+
+    uint32_t format() const { return _format; }
+    uint32_t flags() const { return _flags; }
+    uint32_t nordinals() const { return _nordinals; }
+    uint8_t callingmodel() const { return _cm; }
+    const std::string& title() const { return _title; }
+    const std::string& base() const { return _base; }
+
+    // the number of entries, known without indexing the bucket.
+    uint32_t count(bucket_t bi) const { return _buckets[bi].ndefs; }
+
+    bool contains(bucket_t bi, const std::string& name) const
+    {
+        buildindex(bi);
+        return _buckets[bi].index.count(name) != 0;
+    }
+
+    // decodes a single entry, throws when the name is not in the bucket.
+    Entry get(bucket_t bi, const std::string& name) const
+    {
+        buildindex(bi);
+        auto& index = _buckets[bi].index;
+        auto i = index.find(name);
+        if (i == index.end())
+            throw "til: name not found";
+
+        _is->seekg(i->second);
+        auto s = makehelper(_is);
+        Entry e;
+        e.flags = s.get32le();
+        e.name = getcstr();
+        if (bi == TYPES)
+            e.ordinal = s.get32le();
+        e.type = getcstr();
+        e.fields = getcstr();
+        e.comment = getcstr();
+        e.fieldcomments = getcstr();
+        e.sclass = s.get8();
+        return e;
+    }
+    Entry gettype(const std::string& name) const { return get(TYPES, name); }
+    Entry getsymbol(const std::string& name) const { return get(SYMBOLS, name); }
+
+    // the indexed names, in no particular order.
+    std::vector<std::string> names(bucket_t bi) const
+    {
+        buildindex(bi);
+        std::vector<std::string> result;
+        result.reserve(_buckets[bi].index.size());
+        for (auto& kv : _buckets[bi].index)
+            result.push_back(kv.first);
+        return result;
+    }
+
+    // the name of the type referenced by a serialized type string, like a struct member typeinfo.
+    // Handles a typedef (0x3d), optionally behind a single pointer (0x0a),
+    // followed by the name as a length prefixed string.
+    // returns an empty string for other types, and for references by ordinal ('#').
+    static std::string typedefname(std::string_view type)
+    {
+        size_t i = 0;
+        if (i<type.size() && (type[i]&0x3f)==0x0a)
+            i++;
+        if (i>=type.size() || (type[i]&0x3f)!=0x3d)
+            return {};
+        i++;
+        // the length is stored plus one, in one or two bytes.
+        if (i>=type.size())
+            return {};
+        size_t len = uint8_t(type[i++]);
+        if (len&0x80) {
+            if (i>=type.size())
+                return {};
+            len = (len&0x7f) | (size_t(uint8_t(type[i++]))<<7);
+        }
+        if (len<2 || len-1 > type.size()-i)
+            return {};
+        auto name = type.substr(i, len-1);
+        if (name[0]=='#')
+            return {};
+        return std::string(name);
+    }
+    // the entry for the named type referenced by `type`, see typedefname.
+    std::optional<Entry> resolve(std::string_view type) const
+    {
+        auto name = typedefname(type);
+        if (name.empty() || !contains(TYPES, name))
+            return std::nullopt;
+        return gettype(name);
     }
 };
 
@@ -1747,6 +2995,7 @@ class Unpacker : public BaseUnpacker {
     {
         return _p>=_last;
     }
+    P pos() const { return _p; }
 
     /*
      *  7 bit  - values 0 .. 0x7f
@@ -1818,6 +3067,102 @@ class Unpacker : public BaseUnpacker {
     }
 
 };
+// non virtual unpacker for contiguous data, decodes the same format as Unpacker<P>.
+//
+// Each value needs one bounds check: when enough bytes are left for the
+// largest encoding, the value is decoded without further checks or throw paths.
+// Near the end of the data the checked Unpacker is used.
+template<bool USE64>
+class FastUnpacker {
+    const uint8_t *_p;
+    const uint8_t *_last;
+
+    static uint32_t loadbe16(const uint8_t *p)
+    {
+        return (uint32_t(p[0])<<8) | p[1];
+    }
+    static uint32_t loadbe32(const uint8_t *p)
+    {
+        return (uint32_t(p[0])<<24) | (uint32_t(p[1])<<16) | (uint32_t(p[2])<<8) | p[3];
+    }
+
+    uint32_t slownext32()
+    {
+        Unpacker<const uint8_t*> p(_p, _last, false);
+        uint32_t value = p.next32();
+        _p = p.pos();
+        return value;
+    }
+    uint16_t slownext16()
+    {
+        Unpacker<const uint8_t*> p(_p, _last, false);
+        uint16_t value = p.next16();
+        _p = p.pos();
+        return value;
+    }
+public:
+    FastUnpacker(const uint8_t *first, const uint8_t *last)
+        : _p(first), _last(last)
+    {
+    }
+    bool eof() const
+    {
+        return _p>=_last;
+    }
+    const uint8_t *pos() const { return _p; }
+
+    uint16_t next16()
+    {
+        if (_last-_p < 3)
+            return slownext16();
+        uint8_t byte = *_p;
+        if (byte==0xff) {
+            uint16_t value = loadbe16(_p+1);
+            _p += 3;
+            return value;
+        }
+        if (byte<0x80) {
+            _p += 1;
+            return byte;
+        }
+        uint16_t value = loadbe16(_p) & 0x3FFF;
+        _p += 2;
+        return value;
+    }
+    uint32_t next32()
+    {
+        if (_last-_p < 5)
+            return slownext32();
+        uint8_t byte = *_p;
+        if (byte==0xff) {
+            uint32_t value = loadbe32(_p+1);
+            _p += 5;
+            return value;
+        }
+        if (byte<0x80) {
+            _p += 1;
+            return byte;
+        }
+        if (byte<0xc0) {
+            uint32_t value = loadbe16(_p) & 0x3FFF;
+            _p += 2;
+            return value;
+        }
+        uint32_t value = loadbe32(_p) & 0x1FFFFFFF;
+        _p += 4;
+        return value;
+    }
+    uint64_t nextword()
+    {
+        uint64_t lo = next32();
+        if (USE64) {
+            uint64_t hi = next32();
+            return lo|(hi<<32);
+        }
+        return lo;
+    }
+};
+
 template<typename I, typename O>
 static void idaunpack(I first, I last, O out)
 {
@@ -1834,6 +3179,242 @@ Unpacker<P> makeunpacker(P first, P last, bool use64)
 }
 
 typedef std::vector<uint32_t> DwordVector;
+typedef std::vector<uint64_t> QwordVector;
+
+// returns the number of values starting at `p` which are encoded in a single byte.
+// The lead bytes of a block of data are classified at once, by collecting
+// their high bits. Up to 16 bytes are inspected, `p` must have 16 bytes available.
+inline int countsinglebytevalues(const uint8_t *p)
+{
+#if defined(__SSE2__) || defined(_M_X64)
+    unsigned mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)p));
+    if (mask==0)
+        return 16;
+    return counttrailingzeros(mask);
+#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__==__ORDER_BIG_ENDIAN__
+    for (int i=0 ; i<16 ; i++)
+        if (p[i]&0x80)
+            return i;
+    return 16;
+#else
+    // little endian: the first byte ends up in the lowest bits.
+    uint64_t w[2];
+    memcpy(w, p, 16);
+    for (int i=0 ; i<2 ; i++) {
+        uint64_t mask = w[i] & 0x8080808080808080ULL;
+        if (mask)
+            return 8*i + counttrailingzeros(mask)/8;
+    }
+    return 16;
+#endif
+}
+
+// the number of bytes of the packed 32 bit value starting with `byte`, see Unpacker::next32.
+inline int packedsize32(uint8_t byte)
+{
+    if (byte<0x80) return 1;
+    if (byte<0xc0) return 2;
+    if (byte==0xff) return 5;
+    return 4;
+}
+
+// decode all packed 32 bit values in [first, last) into `out`,
+// which must have room for `last-first` values.
+// returns the number of values decoded, `stop` is set to the end of the
+// last complete value: before `last` when the data ends with a truncated value.
+//
+// Runs of single byte values, the most common case in packed data, are
+// copied without per value decoding, other values go through FastUnpacker.
+inline size_t idaunpackvalues(const uint8_t *first, const uint8_t *last, uint32_t *out, const uint8_t *&stop)
+{
+    uint32_t *o = out;
+    const uint8_t *p = first;
+    while (p < last) {
+        if (last-p >= 16) {
+            int n = countsinglebytevalues(p);
+            for (int i=0 ; i<n ; i++)
+                *o++ = p[i];
+            p += n;
+            if (n==16)
+                continue;
+        }
+        if (last-p < packedsize32(*p))
+            break;
+        FastUnpacker<false> u(p, last);
+        *o++ = u.next32();
+        p = u.pos();
+    }
+    stop = p;
+    return o - out;
+}
+
+// decode a packed blob into a list of 32 bit values.
+inline DwordVector idaunpack32(const std::string& data)
+{
+    auto first = (const uint8_t*)data.data();
+    auto last = first+data.size();
+    const uint8_t *stop;
+    DwordVector values(data.size());
+    values.resize(idaunpackvalues(first, last, values.data(), stop));
+    if (stop != last)
+        throw "unpack: no data";
+    return values;
+}
+
+// decode a packed blob into a list of words.
+// for .i64 databases a word is stored as two consecutive values: low, high.
+inline QwordVector idaunpack64(const std::string& data, bool use64)
+{
+    auto dwords = idaunpack32(data);
+    if (use64 && dwords.size()%2)
+        throw "unpack: no data";
+    QwordVector values;
+    values.reserve(use64 ? dwords.size()/2 : dwords.size());
+    for (size_t i=0 ; i<dwords.size() ; i++) {
+        if (use64) {
+            values.push_back(dwords[i] | (uint64_t(dwords[i+1])<<32));
+            i++;
+        }
+        else {
+            values.push_back(dwords[i]);
+        }
+    }
+    return values;
+}
+
+// unpacker for records which contain only 32 bit values and words,
+// the whole record is decoded at once with idaunpackvalues.
+//
+// There is no next16: 16 bit values use a different encoding.
+//
+// A truncated value at the end of the data is not decoded, and is reported
+// by `truncated()` instead of throwing.
+class BulkUnpacker {
+    DwordVector _values;
+    size_t _i = 0;
+    bool _use64;
+    bool _truncated;
+public:
+    BulkUnpacker(const std::string& data, bool use64)
+        : _values(data.size()), _use64(use64)
+    {
+        auto first = (const uint8_t*)data.data();
+        auto last = first+data.size();
+        const uint8_t *stop;
+        _values.resize(idaunpackvalues(first, last, _values.data(), stop));
+        _truncated = stop != last;
+    }
+    bool truncated() const
+    {
+        return _truncated;
+    }
+    bool eof() const
+    {
+        return _i>=_values.size();
+    }
+    // the number of 32 bit values left, a word takes `wordsize()` values.
+    size_t remaining() const
+    {
+        return _values.size()-_i;
+    }
+    int wordsize() const
+    {
+        return _use64 ? 2 : 1;
+    }
+    uint32_t next32()
+    {
+        if (eof())
+            throw "unpack: no data";
+        return _values[_i++];
+    }
+    uint64_t nextword()
+    {
+        uint64_t lo = next32();
+        if (_use64) {
+            uint64_t hi = next32();
+            return lo|(hi<<32);
+        }
+        return lo;
+    }
+};
+
+// key construction, lookups and packed value decoding for an ID0File
+// with the word size fixed at compile time.
+//
+//     id0.withwordsize([&](auto ws) {
+//         WordID0<decltype(ws)::value> db(id0);
+//         ... db.getuint(node, 'A', i) ...
+//     });
+template<int W>
+class WordID0 {
+    ID0File& _id0;
+public:
+    typedef WordKeys<W> keys;
+    typedef FastUnpacker<W==8> unpacker;
+
+    WordID0(ID0File& id0)
+        : _id0(id0)
+    {
+        if (id0.wordsize()!=W)
+            throw "WordID0: wordsize mismatch";
+    }
+    ID0File& id0() const { return _id0; }
+
+    template<typename...ARGS>
+    static std::string makekey(ARGS...args)
+    {
+        return keys::template make_node_key<std::string>(args...);
+    }
+    template<typename...ARGS>
+    static std::string makename(ARGS...args)
+    {
+        return keys::template make_name_key<std::string>(args...);
+    }
+
+    template<typename...ARGS>
+    auto find(relation_t rel, uint64_t nodeid, ARGS...args)
+    {
+        return _id0.find(rel, keys::template make_node_key<InlineKey>(nodeid, args...));
+    }
+    template<typename...ARGS>
+    std::string getdata(ARGS...args)
+    {
+        auto c = _id0.find(REL_EQUAL, keys::template make_node_key<InlineKey>(args...));
+        if (c.eof())
+            return {};
+        return c.getval();
+    }
+    template<typename...ARGS>
+    uint64_t getuint(ARGS...args)
+    {
+        auto c = _id0.find(REL_EQUAL, keys::template make_node_key<InlineKey>(args...));
+        if (c.eof())
+            return {};
+        return NodeValues::getuint(c.getvalref());
+    }
+    uint64_t node(const std::string& name)
+    {
+        if (1+name.size() > InlineKey::MAXSIZE)
+            return 0;
+        auto c = _id0.find(REL_EQUAL, keys::template make_name_key<InlineKey>(name));
+        if (c.eof())
+            return 0;
+        return NodeValues::getint(c.getvalref());
+    }
+
+    // decode the key at the cursor position,
+    // only valid until the cursor is moved.
+    static KeyView keyview(const BtreeBase::Cursor& c)
+    {
+        return KeyView(c.getkeyref(), std::integral_constant<int, W>());
+    }
+    // the data must stay valid while the unpacker is used.
+    static unpacker makeunpacker(std::string_view data)
+    {
+        auto p = (const uint8_t*)data.data();
+        return unpacker(p, p+data.size());
+    }
+};
 
 // used mostly in lists, where the stored value is one less than the actually used value.
 // lists like: $enums, $structs, $scripts, values of enums, masks of bitfields, values of bitmasks
@@ -1869,7 +3450,9 @@ class StructMember {
     uint32_t _props;
     uint64_t _ofs;
 public:
-    StructMember(ID0File& id0, BaseUnpacker& spec)
+    // UNPACKER is either a BaseUnpacker, or one of the non virtual unpackers.
+    template<typename UNPACKER>
+    StructMember(ID0File& id0, UNPACKER& spec)
         : _id0(id0)
     {
         _nodeid = spec.nextword();
@@ -1879,6 +3462,8 @@ public:
         _props = spec.next32();
         _ofs = 0;
     }
+    // the number of packed values in a member spec, with words of `wordsize` values.
+    static size_t packedsize(int wordsize) { return 3*wordsize + 2; }
     void setofs(uint64_t ofs) { _ofs = ofs; }
 
     uint64_t nodeid() const { return _nodeid + _id0.nodebase(); }
@@ -1890,8 +3475,9 @@ public:
 
     std::string name() const { return _id0.getname(nodeid()); }
 
-    uint64_t enumid() const { return minusone(_id0.getuint(nodeid(), 'A', 11)); }
-    uint64_t structid() const { return minusone(_id0.getuint(nodeid(), 'A', 3)); }
+    // an invalid id value reads as no id.
+    uint64_t enumid() const { return minusone(_id0.trygetuint(nodeid(), 'A', 11).value_or(0)); }
+    uint64_t structid() const { return minusone(_id0.trygetuint(nodeid(), 'A', 3).value_or(0)); }
     std::string comment(bool repeatable) const { return _id0.getstr(nodeid(), 'S', repeatable ? 1 : 0); }
     std::string ptrinfo() const { return _id0.getdata(nodeid(), 'S', 9); }
 
@@ -1925,6 +3511,7 @@ class Struct {
     uint32_t _seqnr;
 
     uint32_t _size;
+    bool _valid = true;
 
     class Iterator : public std::iterator<std::random_access_iterator_tag, StructMember> {
         const Struct* _s;
@@ -1959,17 +3546,18 @@ class Struct {
         bool operator>=(const Iterator& rhs) { return _ix>=rhs._ix; }
     };
 
-public:
-    Struct(ID0File& id0, uint64_t nodeid)
-        : _id0(id0), _nodeid(nodeid)
+    // decode the packed struct info,
+    // returns false when the info is missing, truncated, or has fewer members than specified.
+    bool decodespec(BulkUnpacker& p)
     {
-        auto spec = _id0.blob(_nodeid, 'M');
-        auto p = makeunpacker(spec.begin(), spec.end(), _id0.is64bit());
-
+        if (p.remaining() < 2)
+            return false;
         _flags = p.next32();
         uint32_t nmember = p.next32();
         uint64_t ofs = 0;
         while (nmember--) {
+            if (p.remaining() < StructMember::packedsize(p.wordsize()))
+                return false;
             _members.emplace_back(_id0, p);
             ofs += _members.back().skip();
             _members.back().setofs(ofs);
@@ -1980,7 +3568,37 @@ public:
             _seqnr = p.next32();
         else
             _seqnr = 0;
+        return true;
+    }
+    bool decode()
+    {
+        BulkUnpacker p(_id0.blob(_nodeid, 'M'), _id0.is64bit());
+        if (p.truncated())
+            return false;
+        return decodespec(p);
+    }
+public:
+    Struct(ID0File& id0, uint64_t nodeid)
+        : _id0(id0), _nodeid(nodeid), _flags(0), _seqnr(0), _size(0)
+    {
+        if (!decode())
+            throw "struct: invalid struct info";
+    }
+    // does not throw for missing struct info, check with valid().
+    Struct(ID0File& id0, uint64_t nodeid, std::nothrow_t)
+        : _id0(id0), _nodeid(nodeid), _flags(0), _seqnr(0), _size(0)
+    {
+        _valid = decode();
+    }
+    // returns nullopt when the struct info is missing or incomplete.
+    static std::optional<Struct> tryload(ID0File& id0, uint64_t nodeid)
+    {
+        std::optional<Struct> s(std::in_place, id0, nodeid, std::nothrow);
+        if (!s->valid())
+            return std::nullopt;
+        return s;
     }
+    bool valid() const { return _valid; }
     std::string name() const { return _id0.getname(_nodeid); }
     std::string comment(bool repeatable) const { return _id0.getstr(_nodeid, 'S', repeatable ? 1 : 0); }
     int nmembers() const { return _members.size(); }
@@ -2158,20 +3776,12 @@ public:
 
     BitfieldMask getmask(BtreeBase::Cursor& c)
     {
-        auto key = c.getkey();
-        uint64_t mask;
-
         // get the mask from the key index,
         // ... not really nescesary, since we can also get the mask
         // from the BitfieldValue : node('A',-6) - 1
-        if (_id0.is64bit() ) {
-            assert(key.size()==18);
-            mask = EndianTools::getbe64(&key[10], &key[10]+8);
-        }
-        else {
-            assert(key.size()==10);
-            mask = EndianTools::getbe32(&key[6], &key[6]+4);
-        }
+        auto key = _id0.keyview(c);
+        assert(key.hasindex());
+        uint64_t mask = key.index();
 
         return BitfieldMask(_id0, minusone(_id0.getuint(c)), mask);
     }
@@ -2215,11 +3825,389 @@ public:
     {
         _endkey = _id0.makekey(nodeid, 'A', -1);
     }
-    bool eof() const { return !(_c.getkey() < _endkey); }
-    T next() 
-    { 
+    bool eof() const { return _c.eof() || !(_c.getkeyref() < _endkey); }
+    // the nodeid of the next item, without constructing it.
+    uint64_t nextid()
+    {
         uint64_t id = minusone(_id0.getuint(_c));
         _c.next();
-        return T(_id0, id);
+        return id;
+    }
+    T next() 
+    { 
+        return T(_id0, nextid());
+    }
+};
+
+// the cross reference graph, in compressed sparse row form.
+//
+//   (addr, 'x', toaddr) = reftype     code xref from addr to toaddr
+//   (addr, 'd', toaddr) = reftype     data xref from addr to toaddr
+//
+// the outgoing xrefs of sources[i] are at [offsets[i], offsets[i+1]) in
+// the targets, kinds and reftypes arrays.
+// The (addr, 'X'/'D', fromaddr) records are the same edges in the reverse
+// direction, and are skipped.
+struct XrefGraph {
+    std::vector<uint64_t> sources;      // ascending
+    std::vector<uint64_t> offsets;      // sources.size()+1 items
+    std::vector<uint64_t> targets;
+    std::vector<uint8_t> kinds;         // 'x' = code, 'd' = data
+    std::vector<uint8_t> reftypes;
+
+    XrefGraph()
+        : offsets(1, 0)
+    {
+    }
+    size_t nedges() const { return targets.size(); }
+
+    // loads all xrefs with a single scan over the address nodes.
+    static XrefGraph load(ID0File& id0)
+    {
+        XrefGraph g;
+        id0.withwordsize([&g, &id0](auto ws) {
+            typedef WordID0<decltype(ws)::value> db;
+            id0.scan(db::makekey(0), db::makekey(id0.nodebase()), [&g](BtreeBase::Cursor& c) {
+                g.addrecord(db::keyview(c), c.getvalref());
+                return true;
+            });
+        });
+        g.finish();
+        return g;
+    }
+    // same as load, with the address nodes split over `nthreads` threads, see parallelscan.
+    template<typename OPEN>
+    static XrefGraph load(ID0File& id0, OPEN open, int nthreads)
+    {
+        auto parts = id0.partition(id0.makekey(0), id0.makekey(id0.nodebase()), 4*nthreads);
+        std::vector<XrefGraph> graphs(parts.size());
+        int wordsize = id0.wordsize();
+        parallelscan(parts, open, nthreads, [&graphs, wordsize](size_t part, BtreeBase::Cursor& c) {
+            graphs[part].addrecord(KeyView(c.getkeyref(), wordsize), c.getvalref());
+            return true;
+        });
+        XrefGraph g;
+        for (auto& part : graphs) {
+            part.finish();
+            g.append(part);
+        }
+        return g;
+    }
+
+    // adds an 'x' or 'd' record, other records are ignored.
+    // records must be added in key order.
+    void addrecord(const KeyView& key, std::string_view val)
+    {
+        if ((key.tag()!='x' && key.tag()!='d') || !key.hasindex())
+            return;
+        if (sources.empty() || sources.back()!=key.nodeid()) {
+            if (!sources.empty())
+                offsets.push_back(targets.size());
+            sources.push_back(key.nodeid());
+        }
+        targets.push_back(key.index());
+        kinds.push_back(key.tag());
+        reftypes.push_back(val.empty() ? 0 : val[0]);
+    }
+    // call after the last addrecord.
+    void finish()
+    {
+        if (!sources.empty())
+            offsets.push_back(targets.size());
+    }
+    // appends a finished graph for the keys following the keys of this graph,
+    // the edges of a source split over both graphs are joined.
+    void append(const XrefGraph& g)
+    {
+        if (g.sources.empty())
+            return;
+        size_t base = targets.size();
+        size_t first = 0;
+        if (!sources.empty() && sources.back()==g.sources.front())
+            first = 1;
+        offsets.pop_back();
+        targets.insert(targets.end(), g.targets.begin(), g.targets.end());
+        kinds.insert(kinds.end(), g.kinds.begin(), g.kinds.end());
+        reftypes.insert(reftypes.end(), g.reftypes.begin(), g.reftypes.end());
+        for (size_t j=first ; j<g.sources.size() ; j++) {
+            sources.push_back(g.sources[j]);
+            offsets.push_back(base + g.offsets[j]);
+        }
+        offsets.push_back(targets.size());
+    }
+
+    // returns the [first, last) edge range for `ea`, empty when ea has no xrefs.
+    std::pair<uint64_t, uint64_t> edges(uint64_t ea) const
+    {
+        auto i = std::lower_bound(sources.begin(), sources.end(), ea);
+        if (i==sources.end() || *i!=ea)
+            return { 0, 0 };
+        auto ix = i - sources.begin();
+        return { offsets[ix], offsets[ix+1] };
+    }
+};
+
+// a function, or function tail, from the '$ funcs' list.
+//
+//   ($ funcs, 'S', startea) = packed function info
+//
+// The packed info starts with:
+//   word   startea
+//   word   size:  endea - startea
+//   16bit  flags
+// for function tails, FUNC_TAIL set:
+//   word   startea - owner:  the function this tail belongs to
+//   32bit  number of referers
+// for functions:
+//   word   frame node, word frame size, 16bit saved regs size, word argument size
+//
+// The remaining fields, and later additions by newer ida versions, are ignored.
+// The function tail list in (startea, 'S', 0x7000) holds the same ranges as the tail entries,
+// which are used instead, since they need no extra lookups.
+class Function {
+    ID0File& _id0;
+    uint64_t _start = 0;
+    uint64_t _end = 0;
+    uint64_t _owner = 0;
+    uint16_t _flags = 0;
+
+    // UNPACKER is either a BaseUnpacker, or one of the non virtual unpackers.
+    template<typename UNPACKER>
+    void decode(UNPACKER& p)
+    {
+        _start = p.nextword();
+        _end = _start + p.nextword();
+        _flags = p.next16();
+        _owner = _start;
+        if (istail())
+            _owner = _start - p.nextword();
+    }
+public:
+    enum { FUNC_TAIL = 0x8000 };
+
+    void decodespec(std::string_view spec)
+    {
+        _id0.withwordsize([&](auto ws) {
+            auto p = WordID0<decltype(ws)::value>::makeunpacker(spec);
+            decode(p);
+        });
+    }
+
+    // decode the function at `ea`, throws when ea is not the start of a function or tail.
+    Function(ID0File& id0, uint64_t ea)
+        : _id0(id0)
+    {
+        auto spec = id0.getdata(id0.node("$ funcs"), 'S', ea);
+        if (spec.empty())
+            throw "function not found";
+        decodespec(spec);
+    }
+    // decode a '$ funcs' record value.
+    Function(ID0File& id0, const std::string& spec)
+        : _id0(id0)
+    {
+        decodespec(spec);
+    }
+    // decode from an unpacker positioned at the start of a record value.
+    template<typename UNPACKER, typename = decltype(std::declval<UNPACKER&>().nextword())>
+    Function(ID0File& id0, UNPACKER& p)
+        : _id0(id0)
+    {
+        decode(p);
+    }
+    uint64_t start() const { return _start; }
+    uint64_t end() const { return _end; }
+    uint16_t flags() const { return _flags; }
+    bool istail() const { return (_flags&FUNC_TAIL)!=0; }
+    // the start of the function owning this tail, or start() for a function.
+    uint64_t owner() const { return _owner; }
+
+    std::string name() const { return _id0.getname(_owner); }
+};
+
+// maps addresses to functions, using the chunks of all functions and tails,
+// loaded with a single scan over '$ funcs'.
+class FunctionIndex {
+    struct chunk {
+        uint64_t start;
+        uint64_t end;
+        uint64_t func;
+    };
+    std::vector<chunk> _chunks;   // sorted by start, chunks don't overlap
+    size_t _nfuncs = 0;
+public:
+    FunctionIndex(ID0File& id0)
+    {
+        uint64_t funcs = id0.node("$ funcs");
+        if (!funcs)
+            return;
+        auto lo = id0.makekey(funcs, 'S');
+        id0.withwordsize([&](auto ws) {
+            typedef WordID0<decltype(ws)::value> db;
+            id0.scan(lo, ID0File::prefixend(lo), [&](BtreeBase::Cursor& c) {
+                auto p = db::makeunpacker(c.getvalref());
+                Function f(id0, p);
+                _chunks.push_back({ f.start(), f.end(), f.owner() });
+                if (!f.istail())
+                    _nfuncs++;
+                return true;
+            });
+        });
+        // the keys are big endian, so the chunks are already sorted by start.
+    }
+    // the number of functions, excluding tails
+    size_t size() const { return _nfuncs; }
+    size_t nchunks() const { return _chunks.size(); }
+
+    // returns the start of the function containing `ea`, or BADADDR
+    uint64_t find(uint64_t ea) const
+    {
+        auto i = std::upper_bound(_chunks.begin(), _chunks.end(), ea, [](uint64_t ea, const chunk& c) { return ea < c.start; });
+        if (i==_chunks.begin())
+            return BADADDR;
+        --i;
+        if (ea >= i->end)
+            return BADADDR;
+        return i->func;
+    }
+};
+
+// a segment from the '$ segs' list.
+//
+//   ($ segs, 'S', startea) = packed segment info
+//
+// The packed info is assumed to start with:
+//   word   startea
+//   word   size:  endea - startea
+//   word   name:  index in the '$ segstrings' table
+//   word   class: index in the '$ segstrings' table
+//   word   orgbase
+//   32bit  flags, align, comb, perm, bitness, type
+//   word   selector
+// followed by the default segment register values, which are ignored.
+// Fields missing at the end of the info are left zero.
+struct Segment {
+    uint64_t start = 0;
+    uint64_t end = 0;
+    uint64_t nameindex = 0;
+    uint64_t classindex = 0;
+    uint64_t orgbase = 0;
+    uint32_t flags = 0;
+    uint32_t align = 0;
+    uint32_t comb = 0;
+    uint32_t perm = 0;          // 4 = read, 2 = write, 1 = exec
+    uint32_t bitness = 0;       // 0 = 16 bit, 1 = 32 bit, 2 = 64 bit
+    uint32_t type = 0;
+    uint64_t selector = 0;
+    std::string name;
+    std::string sclass;
+
+    Segment() { }
+    Segment(const std::string& spec, bool use64)
+    {
+        BulkUnpacker p(spec, use64);
+        if (p.truncated())
+            throw "unpack: no data";
+        start = p.nextword();
+        end = start + p.nextword();
+        uint32_t *dwords[] = { &flags, &align, &comb, &perm, &bitness, &type };
+        if (p.eof()) return;
+        nameindex = p.nextword();
+        if (p.eof()) return;
+        classindex = p.nextword();
+        if (p.eof()) return;
+        orgbase = p.nextword();
+        for (auto d : dwords) {
+            if (p.eof()) return;
+            *d = p.next32();
+        }
+        if (p.eof()) return;
+        selector = p.nextword();
+    }
+};
+
+// all segments, sorted by start address, loaded once per database.
+//
+// The segment names are stored in the '$ segstrings' table:
+//   ($ segstrings, 'S', n) = packed: 32bit first, 32bit last, then for each
+//                            index in [first, last): 32bit length + the string bytes
+//
+// When the database has no '$ segs' list, the segment ranges from the id1 header are used.
+class SegmentTable {
+    std::vector<Segment> _segs;
+    bool _fromsegs = false;
+
+    static std::vector<std::string> loadstrings(ID0File& id0)
+    {
+        std::vector<std::string> strings;
+        uint64_t node = id0.node("$ segstrings");
+        if (!node)
+            return strings;
+        auto lo = id0.makekey(node, 'S');
+        id0.scan(lo, ID0File::prefixend(lo), [&strings](BtreeBase::Cursor& c) {
+            auto data = c.getval();
+            auto p = makeunpacker(data.begin(), data.end(), false);
+            uint32_t first = p.next32();
+            uint32_t last = p.next32();
+            if (last > first + data.size())
+                throw "segstrings: invalid range";
+            if (strings.size() < last)
+                strings.resize(last);
+            for (uint32_t i=first ; i<last ; i++) {
+                uint32_t len = p.next32();
+                auto s = p.pos();
+                if (len > size_t(data.end()-s))
+                    throw "segstrings: string too long";
+                strings[i].assign(s, s+len);
+                p = makeunpacker(s+len, data.end(), false);
+            }
+            return true;
+        });
+        return strings;
+    }
+public:
+    SegmentTable(ID0File& id0, ID1File& id1)
+    {
+        uint64_t node = id0.node("$ segs");
+        if (node) {
+            _fromsegs = true;
+            auto strings = loadstrings(id0);
+            auto lo = id0.makekey(node, 'S');
+            id0.scan(lo, ID0File::prefixend(lo), [&](BtreeBase::Cursor& c) {
+                _segs.emplace_back(c.getval(), id0.is64bit());
+                auto& seg = _segs.back();
+                if (seg.nameindex < strings.size())
+                    seg.name = strings[seg.nameindex];
+                if (seg.classindex < strings.size())
+                    seg.sclass = strings[seg.classindex];
+                return true;
+            });
+        }
+        else {
+            for (uint64_t ea = id1.FirstSeg() ; ea != BADADDR ; ea = id1.NextSeg(ea)) {
+                _segs.emplace_back();
+                _segs.back().start = ea;
+                _segs.back().end = id1.SegEnd(ea);
+            }
+        }
+        std::sort(_segs.begin(), _segs.end(), [](const Segment& a, const Segment& b) { return a.start < b.start; });
+    }
+
+    auto begin() const { return _segs.begin(); }
+    auto end() const { return _segs.end(); }
+    size_t size() const { return _segs.size(); }
+    // false when only the id1 segment ranges are known
+    bool hasattributes() const { return _fromsegs; }
+
+    // returns the segment containing `ea`, or nullptr.
+    const Segment* find(uint64_t ea) const
+    {
+        auto i = std::upper_bound(_segs.begin(), _segs.end(), ea, [](uint64_t ea, const Segment& s) { return ea < s.start; });
+        if (i==_segs.begin())
+            return nullptr;
+        --i;
+        if (ea >= i->end)
+            return nullptr;
+        return &*i;
     }
 };
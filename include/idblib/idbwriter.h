@@ -0,0 +1,677 @@
+/*
+ *  idbwriter.h  creates IDApro database structures, the counterpart of idb3.h
+ *
+ * Author: Willem Hengeveld <itsme@xs4all.nl>
+ *
+ * Used for creating test and benchmark databases.
+ *
+ * BtreeWriter writes a v1.5, v1.6 or v2.0 b-tree, as read by BtreeBase.
+ * IDBWriter writes the .idb / .i64 container, as read by IDBFile.
+ * writenamsection / writeid1section write the nam and id1 sections.
+ * idapack16 / idapack32 / idapackword produce packed values as read by Unpacker.
+ * SyntheticID0 generates the records of a synthetic database in key order.
+ */
+#pragma once
+#include <idblib/idb3.h>
+#include <algorithm>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// encode a value in the packed format read by Unpacker::next16
+inline void idapack16(std::string& out, uint16_t value)
+{
+    if (value < 0x80) {
+        out += char(value);
+    }
+    else if (value < 0x4000) {
+        out += char(0x80 | (value>>8));
+        out += char(value);
+    }
+    else {
+        out += char(0xFF);
+        out += char(value>>8);
+        out += char(value);
+    }
+}
+
+// encode a value in the packed format read by Unpacker::next32
+inline void idapack32(std::string& out, uint32_t value)
+{
+    if (value < 0x80) {
+        out += char(value);
+    }
+    else if (value < 0x4000) {
+        out += char(0x80 | (value>>8));
+        out += char(value);
+    }
+    else if (value < 0x20000000) {
+        out += char(0xC0 | (value>>24));
+        out += char(value>>16);
+        out += char(value>>8);
+        out += char(value);
+    }
+    else {
+        out += char(0xFF);
+        out += char(value>>24);
+        out += char(value>>16);
+        out += char(value>>8);
+        out += char(value);
+    }
+}
+// encode a word in the packed format read by Unpacker::nextword
+inline void idapackword(std::string& out, uint64_t value, bool use64)
+{
+    idapack32(out, uint32_t(value));
+    if (use64)
+        idapack32(out, uint32_t(value>>32));
+}
+
+// writes a b-tree database to a seekable stream.
+//
+// Records must be added in ascending key order.
+// Leaf pages are written as soon as the next leaf is started,
+// only the separator records for the index levels are kept in memory.
+// `finish` writes the index levels, and the header page.
+class BtreeWriter {
+    struct Record {
+        std::string key;
+        std::string val;
+        uint32_t pagenr;  // for index records: the page following this record.
+
+        Record(const std::string& key, const std::string& val, uint32_t pagenr = 0)
+            : key(key), val(val), pagenr(pagenr)
+        {
+        }
+    };
+    typedef std::vector<Record> RecordList;
+
+    std::ostream& _os;
+    std::streamoff _base;
+    int _version;
+    int _pagesize;
+
+    uint32_t _npages;       // nr of pages written, including the header page
+    uint64_t _reccount;
+    std::string _lastkey;
+
+    RecordList _leaf;       // the leaf being filled
+    int _leafbytes;
+    RecordList _pending;    // a full leaf, written once `_leaf` has records
+    RecordList _separators; // separators between leaves: the first index level
+    bool _havesep;          // true when _separators.back() still needs a leaf after it
+
+    int headersize() const { return _version==15 ? 4 : 6; }
+    int entrysize() const { return _version==15 ? 4 : 6; }
+    int maxindent() const { return _version==20 ? 0xFFFF : 0xFF; }
+
+    static int commonprefix(const std::string& a, const std::string& b)
+    {
+        auto m = std::mismatch(a.begin(), a.end(), b.begin(), b.end());
+        return m.first - a.begin();
+    }
+
+    int indent(const RecordList& recs, int i, bool isindex) const
+    {
+        if (isindex || i==0)
+            return 0;
+        return std::min(maxindent(), commonprefix(recs[i-1].key, recs[i].key));
+    }
+    // the nr of bytes a record adds to a page, including its entry.
+    int recordbytes(const Record* prev, const Record& rec) const
+    {
+        int indent = prev ? std::min(maxindent(), commonprefix(prev->key, rec.key)) : 0;
+        return entrysize() + 4 + rec.key.size() - indent + rec.val.size();
+    }
+    // the nr of bytes used by an empty page: the header, and a terminating entry.
+    int emptypagebytes() const
+    {
+        return headersize() + entrysize();
+    }
+
+    void writeat(std::streamoff ofs, const std::string& data)
+    {
+        _os.seekp(_base + ofs);
+        _os.write(data.data(), data.size());
+    }
+
+    // write a page, `preceeding` is zero for leaf pages.
+    uint32_t writepage(uint32_t preceeding, const RecordList& recs)
+    {
+        uint32_t nr = _npages++;
+        if (_version==15 && nr > 0xFFFF)
+            throw "btreewriter: too many pages for v1.5";
+
+        std::string page(_pagesize, char(0));
+        auto et = EndianTools();
+        auto first = page.begin();
+        auto last = page.end();
+
+        auto oi = first;
+        if (_version==15) {
+            et.setle16(oi, last, preceeding); oi += 2;
+        }
+        else {
+            et.setle32(oi, last, preceeding); oi += 4;
+        }
+        et.setle16(oi, last, recs.size());  oi += 2;
+
+        int adjust = _version==20 ? 0 : 1;
+        int od = _pagesize;
+        for (unsigned i=0 ; i<recs.size() ; i++) {
+            auto& rec = recs[i];
+            int indent = this->indent(recs, i, preceeding!=0);
+            int klen = rec.key.size()-indent;
+            od -= 4 + klen + rec.val.size();
+
+            if (preceeding) {
+                if (_version==15) {
+                    et.setle16(oi, last, rec.pagenr); oi += 2;
+                }
+                else {
+                    et.setle32(oi, last, rec.pagenr); oi += 4;
+                }
+            }
+            else if (_version==20) {
+                et.setle16(oi, last, indent); oi += 4;
+            }
+            else {
+                et.set8(oi, last, indent);  oi += _version==15 ? 2 : 4;
+            }
+            et.setle16(oi, last, od-adjust); oi += 2;
+
+            auto p = first + od;
+            et.setle16(p, last, klen);  p += 2;
+            p = std::copy(rec.key.begin()+indent, rec.key.end(), p);
+            et.setle16(p, last, rec.val.size());  p += 2;
+            std::copy(rec.val.begin(), rec.val.end(), p);
+        }
+
+        writeat(std::streamoff(nr)*_pagesize, page);
+        return nr;
+    }
+
+    void writeheader(uint32_t root)
+    {
+        std::string hdr(64, char(0));
+        auto et = EndianTools();
+        auto p = hdr.begin();
+        if (_version==15) {
+            et.setle16(p, hdr.end(), 0);  p += 2;  // firstfree
+            et.setle16(p, hdr.end(), _pagesize);  p += 2;
+            et.setle16(p, hdr.end(), root);  p += 2;
+            et.setle32(p, hdr.end(), _reccount);  p += 4;
+            et.setle16(p, hdr.end(), _npages);  p += 2;
+            std::string sig = "B-tree v 1.5 (C) Pol 1990";
+            std::copy(sig.begin(), sig.end(), hdr.begin()+13);
+        }
+        else {
+            et.setle32(p, hdr.end(), 0);  p += 4;  // firstfree
+            et.setle16(p, hdr.end(), _pagesize);  p += 2;
+            et.setle32(p, hdr.end(), root);  p += 4;
+            et.setle32(p, hdr.end(), _reccount);  p += 4;
+            et.setle32(p, hdr.end(), _npages);  p += 4;
+            std::string sig = _version==16 ? "B-tree v 1.6 (C) Pol 1990" : "B-tree v2";
+            std::copy(sig.begin(), sig.end(), hdr.begin()+19);
+        }
+        writeat(0, hdr);
+    }
+
+    // write the pages for one index level,
+    // returns the root page when this level fits in a single page.
+    uint32_t writelevel(uint32_t firstchild, const RecordList& items)
+    {
+        if (items.empty())
+            return firstchild;
+
+        RecordList upper;
+        uint32_t firstpage = _npages;
+        uint32_t preceeding = firstchild;
+        size_t i = 0;
+        while (i < items.size()) {
+            RecordList page;
+            int bytes = emptypagebytes();
+            while (i < items.size() && bytes + recordbytes(nullptr, items[i]) <= _pagesize) {
+                bytes += recordbytes(nullptr, items[i]);
+                page.push_back(items[i++]);
+            }
+
+            // don't leave a single item: it would become a separator without a page after it.
+            if (i+1 == items.size() && page.size()>1) {
+                page.pop_back();
+                i--;
+            }
+            writepage(preceeding, page);
+            if (i < items.size()) {
+                // the separator points to the next page of this level.
+                upper.emplace_back(items[i].key, items[i].val, _npages);
+                preceeding = items[i].pagenr;
+                i++;
+            }
+        }
+        if (upper.empty())
+            return firstpage;
+        return writelevel(firstpage, upper);
+    }
+
+    // write the pending leaf, now that we know the next leaf will not be empty.
+    void flushpending()
+    {
+        if (_pending.empty())
+            return;
+        writepage(0, _pending);
+        _pending.clear();
+        if (_havesep) {
+            // the next page written is the leaf following this separator.
+            _separators.back().pagenr = _npages;
+            _havesep = false;
+        }
+    }
+public:
+    BtreeWriter(std::ostream& os, int version, int pagesize = 0x2000)
+        : _os(os), _base(os.tellp()), _version(version), _pagesize(pagesize),
+          _npages(1), _reccount(0), _leafbytes(emptypagebytes()), _havesep(false)
+    {
+        if (version!=15 && version!=16 && version!=20)
+            throw "btreewriter: unsupported version";
+        // placeholder for the header page
+        writeat(0, std::string(_pagesize, char(0)));
+    }
+
+    void add(const std::string& key, const std::string& val)
+    {
+        if (_reccount && !(_lastkey < key))
+            throw "btreewriter: keys not ascending";
+
+        Record rec(key, val);
+        // also check the worst case: without prefix compression, in an index page.
+        if (emptypagebytes() + recordbytes(nullptr, rec) > _pagesize)
+            throw "btreewriter: record too large";
+
+        if (!_pending.empty() && _havesep && _leaf.empty())
+            flushpending();
+
+        int bytes = recordbytes(_leaf.empty() ? nullptr : &_leaf.back(), rec);
+        if (_leafbytes + bytes <= _pagesize) {
+            _leaf.push_back(rec);
+            _leafbytes += bytes;
+        }
+        else {
+            // the leaf is full, this record separates it from the next leaf.
+            _pending.swap(_leaf);
+            _leaf.clear();
+            _leafbytes = emptypagebytes();
+            _separators.push_back(rec);
+            _havesep = true;
+        }
+        _lastkey = key;
+        _reccount++;
+    }
+
+    // writes the remaining leaves, the index levels and the header.
+    // returns the total size of the b-tree.
+    uint64_t finish()
+    {
+        if (_havesep && _leaf.empty()) {
+            // the last separator has no leaf after it: shift a record from the pending leaf.
+            if (_pending.size() < 2)
+                throw "btreewriter: pagesize too small";
+            _leaf.push_back(_separators.back());
+            _separators.back() = _pending.back();
+            _pending.pop_back();
+        }
+        flushpending();
+        writepage(0, _leaf);
+
+        // leaves are written first, starting directly after the header page.
+        uint32_t root = writelevel(1, _separators);
+        writeheader(root);
+
+        _os.seekp(_base + std::streamoff(_npages)*_pagesize);
+        return uint64_t(_npages)*_pagesize;
+    }
+};
+
+// write a 'VA*' style nam section with `nnames` named offsets,
+// `offset(i)` returns the i-th offset, in ascending order.
+// returns the size of the section.
+template<typename OFFSETFN>
+uint64_t writenamsection(std::ostream& os, uint64_t nnames, int wordsize, OFFSETFN offset)
+{
+    std::string hdr(0x2000, char(0));
+    auto et = EndianTools();
+    auto nk = NodeKeys(wordsize);
+    auto p = hdr.begin();
+    et.setle32(p, hdr.end(), 0x2a4156);  p += 4;
+    et.setle32(p, hdr.end(), 3);         p += 4;
+    et.setle32(p, hdr.end(), 1 + (nnames*wordsize+0x1FFF)/0x2000);  p += 4;  // npages
+    et.setle32(p, hdr.end(), 0x800);     p += 4;
+    et.setle32(p, hdr.end(), 0x15);      p += 4;
+    p += wordsize;
+    // 64 bit databases store twice the nr of names.
+    nk.setwordle(p, hdr.end(), wordsize==8 ? 2*nnames : nnames);
+    os.write(hdr.data(), hdr.size());
+
+    std::string chunk;
+    for (uint64_t i=0 ; i<nnames ; i++) {
+        chunk.resize(chunk.size()+wordsize);
+        nk.setwordle(chunk.end()-wordsize, chunk.end(), offset(i));
+        if (chunk.size() >= 0x10000) {
+            os.write(chunk.data(), chunk.size());
+            chunk.clear();
+        }
+    }
+    os.write(chunk.data(), chunk.size());
+    return hdr.size() + nnames*wordsize;
+}
+inline uint64_t writenamsection(std::ostream& os, const std::vector<uint64_t>& offsets, int wordsize)
+{
+    return writenamsection(os, offsets.size(), wordsize, [&](uint64_t i) { return offsets[i]; });
+}
+
+// write a 'VA*' style id1 section, with the flags for all addresses in `segments`,
+// `flags(ea)` returns the flags for an address.
+// returns the size of the section.
+template<typename FLAGSFN>
+uint64_t writeid1section(std::ostream& os, const std::vector<std::pair<uint64_t, uint64_t>>& segments, int wordsize, FLAGSFN flags)
+{
+    uint64_t naddrs = 0;
+    for (auto& seg : segments)
+        naddrs += seg.second - seg.first;
+
+    std::string hdr(0x2000, char(0));
+    auto et = EndianTools();
+    auto nk = NodeKeys(wordsize);
+    auto p = hdr.begin();
+    et.setle32(p, hdr.end(), 0x2a4156);  p += 4;
+    et.setle32(p, hdr.end(), 3);         p += 4;
+    et.setle32(p, hdr.end(), segments.size());  p += 4;
+    et.setle32(p, hdr.end(), 0x800);     p += 4;
+    et.setle32(p, hdr.end(), (naddrs*4+0x1FFF)/0x2000);  p += 4;  // npages
+    for (auto& seg : segments) {
+        nk.setwordle(p, hdr.end(), seg.first);  p += wordsize;
+        nk.setwordle(p, hdr.end(), seg.second);  p += wordsize;
+    }
+    os.write(hdr.data(), hdr.size());
+
+    std::string chunk;
+    for (auto& seg : segments) {
+        for (uint64_t ea = seg.first ; ea < seg.second ; ea++) {
+            chunk.resize(chunk.size()+4);
+            et.setle32(chunk.end()-4, chunk.end(), flags(ea));
+            if (chunk.size() >= 0x10000) {
+                os.write(chunk.data(), chunk.size());
+                chunk.clear();
+            }
+        }
+    }
+    os.write(chunk.data(), chunk.size());
+    return hdr.size() + naddrs*4;
+}
+
+// writes an .idb or .i64 container, in the fileversion 6 format.
+//
+// Sections are written with:
+//     beginsection(ID0File::INDEX);
+//     ... write the section data to the stream ...
+//     endsection();
+// `finish` writes the header. Checksums are not calculated, they are left zero.
+class IDBWriter {
+    std::ostream& _os;
+    uint32_t _magic;
+    std::vector<uint64_t> _offsets;
+    int _current;
+
+    enum { HEADERSIZE = 0x100 };
+public:
+    IDBWriter(std::ostream& os, uint32_t magic)
+        : _os(os), _magic(magic), _offsets(6), _current(-1)
+    {
+        _os.write(std::string(HEADERSIZE, char(0)).data(), HEADERSIZE);
+    }
+
+    // section data is written after a 9 byte header: <compression:8> <size:64>
+    void beginsection(int i)
+    {
+        if (_current>=0)
+            throw "idbwriter: section not ended";
+        _current = i;
+        _offsets[i] = _os.tellp();
+        _os.write(std::string(9, char(0)).data(), 9);
+    }
+    void endsection()
+    {
+        if (_current<0)
+            throw "idbwriter: no section started";
+        uint64_t end = _os.tellp();
+        uint64_t start = _offsets[_current];
+
+        std::string size(8, char(0));
+        EndianTools::setle64(size.begin(), size.end(), end - start - 9);
+        _os.seekp(start + 1);
+        _os.write(size.data(), size.size());
+        _os.seekp(end);
+        _current = -1;
+    }
+    void finish()
+    {
+        if (_current>=0)
+            throw "idbwriter: section not ended";
+        std::string hdr(HEADERSIZE, char(0));
+        auto et = EndianTools();
+        auto p = hdr.begin();
+        et.setle32(p, hdr.end(), _magic);       p += 4;
+        p += 2;
+        et.setle64(p, hdr.end(), _offsets[0]);  p += 8;
+        et.setle64(p, hdr.end(), _offsets[1]);  p += 8;
+        p += 4;
+        et.setle32(p, hdr.end(), 0xaabbccdd);   p += 4;
+        et.setle16(p, hdr.end(), 6);            p += 2;  // fileversion
+        et.setle64(p, hdr.end(), _offsets[2]);  p += 8;
+        et.setle64(p, hdr.end(), _offsets[3]);  p += 8;
+        et.setle64(p, hdr.end(), _offsets[4]);  p += 8;
+        p += 5*4;   // checksums
+        et.setle64(p, hdr.end(), _offsets[5]);  p += 8;
+
+        auto end = _os.tellp();
+        _os.seekp(0);
+        _os.write(hdr.data(), hdr.size());
+        _os.seekp(end);
+    }
+};
+
+// generates a synthetic database: `nnames` named addresses,
+// plus one struct and one enum for every 64 names.
+//
+// `segments`, `flags` and `address` provide the contents for the id1
+// and nam sections.
+// `generate` produces the id0 records in ascending key order,
+// so they can be passed directly to BtreeWriter::add.
+// Every 16th address gets a long name, stored as a blob
+// in the (nodebase, 'S') records.
+class SyntheticID0 {
+    int _wordsize;
+    uint64_t _nnames;
+    uint64_t _nstructs;
+    uint64_t _nenums;
+public:
+    enum {
+        NSTRUCTMEMBERS = 8,
+        NENUMMEMBERS = 8,
+        LONGNAMEINTERVAL = 16,
+        FIRSTSTRUCT = 0x10,     // relative to nodebase
+        BASEADDRESS = 0x10000,
+    };
+
+    SyntheticID0(int wordsize, uint64_t nnames)
+        : _wordsize(wordsize), _nnames(nnames),
+          _nstructs(nnames/64+1), _nenums(nnames/64+1)
+    {
+    }
+    uint64_t nodebase() const { return uint64_t(0xFF)<<((_wordsize-1)*8); }
+    uint64_t nnames() const { return _nnames; }
+    uint64_t nstructs() const { return _nstructs; }
+    uint64_t nenums() const { return _nenums; }
+
+    uint64_t rootnode() const { return nodebase()+1; }
+    uint64_t structlist() const { return nodebase()+2; }
+    uint64_t enumlist() const { return nodebase()+3; }
+    uint64_t structnode(uint64_t i) const { return nodebase() + FIRSTSTRUCT + i*(1+NSTRUCTMEMBERS); }
+    uint64_t enumnode(uint64_t i) const { return structnode(_nstructs) + i*(1+NENUMMEMBERS); }
+    uint64_t maxnode() const { return enumnode(_nenums); }
+
+    uint64_t address(uint64_t i) const { return BASEADDRESS + i*0x10; }
+
+    // all addresses are in a single segment.
+    std::vector<std::pair<uint64_t, uint64_t>> segments() const
+    {
+        return { { address(0), address(_nnames) } };
+    }
+    // the named addresses are code heads, the other bytes tails.
+    uint32_t flags(uint64_t ea) const
+    {
+        if ((ea - BASEADDRESS)%0x10 == 0)
+            return 0x4600 | (ea&0xFF);  // FF_NAME | FF_CODE
+        return 0x200 | (ea&0xFF);       // FF_TAIL
+    }
+    bool islongname(uint64_t i) const { return i%LONGNAMEINTERVAL == LONGNAMEINTERVAL-1; }
+    std::string name(uint64_t i) const
+    {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "sub_%08llX", (unsigned long long)address(i));
+        std::string name = buf;
+        if (islongname(i)) {
+            name += '_';
+            while (name.size() < 600 + i%256)
+                name += char('a' + name.size()%26);
+        }
+        return name;
+    }
+    static std::string hexname(const char *prefix, uint64_t i, int j = -1)
+    {
+        char buf[32];
+        if (j<0)
+            snprintf(buf, sizeof(buf), "%s%06llX", prefix, (unsigned long long)i);
+        else
+            snprintf(buf, sizeof(buf), "%s%06llX_%02X", prefix, (unsigned long long)i, j);
+        return buf;
+    }
+    std::string structname(uint64_t i) const { return hexname("struc_", i); }
+    std::string enumname(uint64_t i) const { return hexname("enum_", i); }
+    std::string enummembername(uint64_t i, int j) const { return hexname("ev_", i, j); }
+
+    std::string word(uint64_t w) const
+    {
+        std::string val(_wordsize, char(0));
+        NodeKeys(_wordsize).setwordle(val.begin(), val.end(), w);
+        return val;
+    }
+    std::string structspec(uint64_t i) const
+    {
+        std::string spec;
+        idapack32(spec, 0);                 // flags
+        idapack32(spec, NSTRUCTMEMBERS);
+        for (int j=0 ; j<NSTRUCTMEMBERS ; j++) {
+            idapackword(spec, structnode(i)+1+j - nodebase(), _wordsize==8);
+            idapackword(spec, 0, _wordsize==8);             // skip
+            idapackword(spec, 1<<(j%4), _wordsize==8);      // size
+            idapack32(spec, 0x10000400);                    // flags
+            idapack32(spec, 0);                             // props
+        }
+        idapack32(spec, i);                 // seqnr
+        return spec;
+    }
+
+    template<typename ADD>
+    void generate(ADD add) const
+    {
+        NodeKeys nk(_wordsize);
+        auto key = [&](auto...args) { return nk.make_node_key<std::string>(args...); };
+
+        add("$ MAX LINK", word(0));
+        add("$ MAX NODE", word(maxnode()));
+
+        // named addresses
+        uint64_t nameid = 0;
+        for (uint64_t i=0 ; i<_nnames ; i++) {
+            if (islongname(i)) {
+                std::string ref(1+_wordsize, char(0));
+                nk.setwordbe(ref.begin()+1, ref.end(), nameid++);
+                add(key(address(i), 'N'), ref);
+            }
+            else {
+                add(key(address(i), 'N'), name(i));
+            }
+        }
+
+        // the long names, in chunks of 256 bytes
+        nameid = 0;
+        for (uint64_t i=0 ; i<_nnames ; i++) {
+            if (!islongname(i))
+                continue;
+            auto longname = name(i);
+            for (uint64_t o=0 ; o<longname.size() ; o+=256)
+                add(key(nodebase(), 'S', nameid*256 + o/256), longname.substr(o, 256));
+            nameid++;
+        }
+
+        std::string rootparams = std::string("IDA\x00\x00", 5) + std::string("metapc\x00\x00", 8);
+        add(key(rootnode(), 'A', -5), word(0x12345678));   // crc
+        add(key(rootnode(), 'A', -4), word(1));            // nopens
+        add(key(rootnode(), 'A', -2), word(0x5a000000));   // ctime
+        add(key(rootnode(), 'A', -1), word(700));          // version
+        add(key(rootnode(), 'N'), "Root Node");
+        add(key(rootnode(), 'S', 1302), std::string(16, char(0x5a)));
+        add(key(rootnode(), 'S', 1303), "7.00");
+        add(key(rootnode(), 'S', 0x41b994), rootparams);
+
+        for (uint64_t i=0 ; i<_nstructs ; i++)
+            add(key(structlist(), 'A', i), word(structnode(i)+1));
+        add(key(structlist(), 'A', -1), word(_nstructs));
+        add(key(structlist(), 'N'), "$ structs");
+
+        for (uint64_t i=0 ; i<_nenums ; i++)
+            add(key(enumlist(), 'A', i), word(enumnode(i)+1));
+        add(key(enumlist(), 'A', -1), word(_nenums));
+        add(key(enumlist(), 'N'), "$ enums");
+
+        for (uint64_t i=0 ; i<_nstructs ; i++) {
+            add(key(structnode(i), 'M', 0), structspec(i));
+            add(key(structnode(i), 'N'), structname(i));
+            for (int j=0 ; j<NSTRUCTMEMBERS ; j++)
+                add(key(structnode(i)+1+j, 'N'), hexname("field_", j));
+        }
+
+        for (uint64_t i=0 ; i<_nenums ; i++) {
+            uint64_t node = enumnode(i);
+            add(key(node, 'A', -5), word(0));           // flags
+            add(key(node, 'A', -3), word(0x1100000));   // representation: hex
+            add(key(node, 'A', -1), word(NENUMMEMBERS));
+            for (int j=0 ; j<NENUMMEMBERS ; j++)
+                add(key(node, 'E', j), word(node+1+j+1));
+            add(key(node, 'N'), enumname(i));
+            for (int j=0 ; j<NENUMMEMBERS ; j++) {
+                add(key(node+1+j, 'A', -3), word(j));
+                add(key(node+1+j, 'A', -2), word(node+1));
+                add(key(node+1+j, 'N'), enummembername(i, j));
+            }
+        }
+
+        // the name index, in ascending name order
+        add(nk.make_name_key<std::string>("$ enums"), word(enumlist()));
+        add(nk.make_name_key<std::string>("$ structs"), word(structlist()));
+        add(nk.make_name_key<std::string>("Root Node"), word(rootnode()));
+        for (uint64_t i=0 ; i<_nenums ; i++)
+            add(nk.make_name_key<std::string>(enumname(i)), word(enumnode(i)));
+        for (uint64_t i=0 ; i<_nenums ; i++)
+            for (int j=0 ; j<NENUMMEMBERS ; j++)
+                add(nk.make_name_key<std::string>(enummembername(i, j)), word(enumnode(i)+1+j));
+        for (uint64_t i=0 ; i<_nstructs ; i++)
+            add(nk.make_name_key<std::string>(structname(i)), word(structnode(i)));
+        // long names don't fit in a key.
+        for (uint64_t i=0 ; i<_nnames ; i++)
+            if (!islongname(i))
+                add(nk.make_name_key<std::string>(name(i)), word(address(i)));
+    }
+};
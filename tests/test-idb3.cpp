@@ -220,6 +220,90 @@ TEST_CASE("test_NodeValues")
     CHECK( NodeValues::getuint("\x12") == 0x12 );
 }
 
+TEST_CASE("test_KeyView")
+{
+    for (int wordsize : { 4, 8 }) {
+        NodeKeys nk(wordsize);
+        uint64_t nodeid = wordsize==8 ? 0xFF00000000000123 : 0xFF000123;
+
+        auto k1 = nk.make_node_key<std::string>(nodeid, 'S', 0x1234);
+        KeyView kv1(k1, wordsize);
+        CHECK( kv1.kind() == '.' );
+        CHECK( kv1.isnode() );
+        CHECK( kv1.nodeid() == nodeid );
+        CHECK( kv1.tag() == 'S' );
+        CHECK( kv1.hasindex() );
+        CHECK( kv1.index() == 0x1234 );
+        CHECK( kv1.hashkey().empty() );
+
+        auto k2 = nk.make_node_key<std::string>(nodeid, 'N');
+        KeyView kv2(k2, wordsize);
+        CHECK( kv2.nodeid() == nodeid );
+        CHECK( kv2.tag() == 'N' );
+        CHECK( !kv2.hasindex() );
+
+        auto k3 = nk.make_node_key<std::string>(nodeid, 'H', std::string("abc"));
+        KeyView kv3(k3, wordsize);
+        CHECK( kv3.tag() == 'H' );
+        CHECK( !kv3.hasindex() );
+        CHECK( kv3.hashkey() == "abc" );
+
+        // a hashkey of wordsize bytes is not taken for an index.
+        auto hk = std::string(wordsize, 'x');
+        auto k6 = nk.make_node_key<std::string>(nodeid, 'H', hk);
+        KeyView kv6(k6, wordsize);
+        CHECK( !kv6.hasindex() );
+        CHECK( kv6.hashkey() == hk );
+
+        auto k4 = nk.make_name_key<std::string>("Root Node");
+        KeyView kv4(k4, wordsize);
+        CHECK( kv4.isname() );
+        CHECK( !kv4.isnode() );
+        CHECK( kv4.name() == "Root Node" );
+        CHECK( kv4.nodeid() == 0 );
+
+        KeyView kv5("$ MAX NODE", wordsize);
+        CHECK( kv5.kind() == '$' );
+        CHECK( kv5.tag() == 0 );
+    }
+}
+
+TEST_CASE("test_WordKeys")
+{
+    CHECK( WordKeys<4>::make_node_key<std::string>(0xFF000123, 'S', 0x1234) == std::string(".\xff\x00\x01\x23S\x00\x00\x12\x34", 10) );
+    CHECK( WordKeys<4>::make_node_key<std::string>(0xFF000123, 'A', -1) == std::string(".\xff\x00\x01\x23" "A\xff\xff\xff\xff", 10) );
+    CHECK( WordKeys<8>::make_node_key<std::string>(0xFF00000000000123, 'N') == std::string(".\xff\x00\x00\x00\x00\x00\x01\x23N", 10) );
+    CHECK( WordKeys<8>::make_name_key<std::string>(0x1234) == std::string("N\x00\x00\x00\x00\x00\x00\x12\x34", 9) );
+    CHECK( WordKeys<4>::make_name_key<std::string>("abc") == "Nabc" );
+    CHECK( WordKeys<4>::make_node_key<std::string>(0x1000, 'H', std::string("xy")) == std::string(".\x00\x00\x10\x00Hxy", 8) );
+
+    for (int wordsize : { 4, 8 }) {
+        NodeKeys nk(wordsize);
+        withwordsize(wordsize, [&](auto ws) {
+            typedef WordKeys<decltype(ws)::value> wk;
+            CHECK( wk::WORDSIZE == wordsize );
+            auto key = wk::template make_node_key<std::string>(0x401000, 'x', 0x402000);
+            CHECK( key == nk.make_node_key<std::string>(0x401000, 'x', 0x402000) );
+            CHECK( nk.wordsize() == wordsize );
+            CHECK( nk.make_node_key<InlineKey>(0x401000, 'H', std::string("xy")).view() == wk::template make_node_key<std::string>(0x401000, 'H', std::string("xy")) );
+            CHECK( nk.make_name_key<std::string>(0x1234) == wk::template make_name_key<std::string>(0x1234) );
+
+            KeyView kv(key, ws);
+            CHECK( kv.nodeid() == 0x401000 );
+            CHECK( kv.tag() == 'x' );
+            CHECK( kv.index() == 0x402000 );
+        });
+    }
+    CHECK_THROWS( NodeKeys(2).make_node_key<std::string>(1, 'N') );
+
+    auto ik = WordKeys<8>::make_node_key<InlineKey>(0x401000, 'S', 3);
+    CHECK( ik.size() == 18 );
+    CHECK( ik.view() == WordKeys<8>::make_node_key<std::string>(0x401000, 'S', 3) );
+    CHECK( WordKeys<4>::make_name_key<InlineKey>("abc").str() == "Nabc" );
+    CHECK( WordKeys<4>::make_name_key<InlineKey>(std::string(511, 'x')).size() == 512 );
+    CHECK_THROWS( WordKeys<4>::make_name_key<InlineKey>(std::string(512, 'x')) );
+}
+
 TEST_CASE("test_Packer")
 {
     std::string val("\x00\x04\x88\xf1\x00\x04\xc0\x20\x00\x04\x01\x88\xf2\x00\x04\xc0\x20\x00\x04\x01\x88\xf3\x00\x04\xc0\x25\x50\x04\x11\x88\xf4\x00\x04\xc0\x25\x50\x04\x11\x02", 39);
@@ -237,3 +321,234 @@ TEST_CASE("test_Packer")
 }
 
 
+
+// an .idb header, without any sections.
+std::string CreateTestIdbHeader(uint32_t magic)
+{
+    std::string hdr(30, char(0));
+    EndianTools::setle32(hdr.begin(), hdr.end(), magic);
+    return hdr;
+}
+
+// a 32 bit 'Va4' style nam section.
+std::string CreateTestNamSection(const std::vector<uint32_t>& offsets)
+{
+    std::string nam(0x20 + 4*offsets.size(), char(0));
+    auto et = EndianTools();
+    et.setle32(nam.begin(), nam.end(), 0x346156);
+    et.setle16(nam.begin()+4, nam.end(), 1);            // npages
+    et.setle16(nam.begin()+6, nam.end(), 0);            // eof
+    et.setle32(nam.begin()+8, nam.end(), 0);            // unknown
+    et.setle32(nam.begin()+12, nam.end(), offsets.size());
+    et.setle32(nam.begin()+16, nam.end(), 0x20);        // listofs
+    for (unsigned i=0 ; i<offsets.size() ; i++)
+        et.setle32(nam.begin()+0x20+4*i, nam.end(), offsets[i]);
+    return nam;
+}
+
+TEST_CASE("test_NAMFile")
+{
+    IDBFile idb(std::make_shared<std::stringstream>(CreateTestIdbHeader(IDBFile::MAGIC_IDA1)));
+
+    std::vector<uint32_t> offsets;
+    for (uint32_t ea = 0x1000 ; ea < 0x1000+100*0x10 ; ea += 0x10)
+        offsets.push_back(ea);
+    NAMFile nam(idb, std::make_shared<std::stringstream>(CreateTestNamSection(offsets)));
+
+    CHECK( nam.numnames() == 100 );
+    CHECK( nam.firstnamed() == 0x1000 );
+
+    std::vector<uint64_t> eas = { 0, 0x1000, 0x1001, 0x100f, 0x1010, 0x1234, 0x1630, 0x1650, 0x10000 };
+    std::vector<uint64_t> expected = { 0x1000, 0x1000, 0x1000, 0x1000, 0x1010, 0x1230, 0x1630, 0x1630, 0x1630 };
+
+    for (unsigned i=0 ; i<eas.size() ; i++)
+        CHECK( nam.findname(eas[i]) == expected[i] );
+    CHECK( nam.findnames(eas) == expected );
+
+    // unsorted input
+    std::vector<uint64_t> reversed(eas.rbegin(), eas.rend());
+    CHECK( nam.findnames(reversed) == std::vector<uint64_t>(expected.rbegin(), expected.rend()) );
+
+    nam.buildsearchindex();
+    CHECK( nam.hassearchindex() );
+    for (unsigned i=0 ; i<eas.size() ; i++)
+        CHECK( nam.findname(eas[i]) == expected[i] );
+
+    // check every position against the plain binary search.
+    for (uint64_t ea = 0xff0 ; ea < 0x1700 ; ea++) {
+        auto i = std::upper_bound(offsets.begin(), offsets.end(), ea);
+        if (i!=offsets.begin()) --i;
+        CHECK( nam.findname(ea) == *i );
+    }
+}
+
+TEST_CASE("test_FastUnpacker")
+{
+    // all encodings, including values near the end of the data.
+    std::string val("\x00\x7f\x80\x80\xbf\xff\xc0\x00\x40\x00\xdf\xff\xff\xff\xff\x12\x34\x56\x78\x05\x81\x23\xff\xab\xcd\xef\x01", 27);
+    auto first = (const uint8_t*)val.data();
+    auto last = first + val.size();
+
+    Unpacker<const uint8_t*> slow(first, last, false);
+    FastUnpacker<false> fast(first, last);
+
+    DwordVector check = { 0x00, 0x7f, 0x80, 0x3fff, 0x4000, 0x1fffffff, 0x12345678, 0x05, 0x123, 0xabcdef01 };
+    for (auto v : check) {
+        CHECK( slow.next32() == v );
+        CHECK( fast.next32() == v );
+    }
+    CHECK( fast.eof() );
+    CHECK_THROWS( fast.next32() );
+
+    // 64 bit words are stored as low, high
+    std::string word("\x81\x23\xff\xab\xcd\xef\x01", 7);
+    FastUnpacker<true> fast64((const uint8_t*)word.data(), (const uint8_t*)word.data()+word.size());
+    CHECK( fast64.nextword() == 0xabcdef0100000123 );
+
+    std::string half("\x12\xff\x12\x34\x81\x23", 6);
+    FastUnpacker<false> fast16((const uint8_t*)half.data(), (const uint8_t*)half.data()+half.size());
+    CHECK( fast16.next16() == 0x12 );
+    CHECK( fast16.next16() == 0x1234 );
+    CHECK( fast16.next16() == 0x123 );
+    CHECK( fast16.eof() );
+
+    // truncated value
+    std::string trunc("\xc0\x00", 2);
+    FastUnpacker<false> fastt((const uint8_t*)trunc.data(), (const uint8_t*)trunc.data()+trunc.size());
+    CHECK_THROWS( fastt.next32() );
+}
+
+TEST_CASE("test_idaunpack32")
+{
+    std::string val("\x00\x04\x88\xf1\x00\x04\xc0\x20\x00\x04\x01\x88\xf2\x00\x04\xc0\x20\x00\x04\x01\x88\xf3\x00\x04\xc0\x25\x50\x04\x11\x88\xf4\x00\x04\xc0\x25\x50\x04\x11\x02", 39);
+    DwordVector check = { 0x00,0x04,0x8f1,0x00,0x04,0x0200004,0x01,0x8f2,0x00,0x04,0x0200004,0x01,0x8f3,0x00,0x04,0x0255004,0x11,0x8f4,0x00,0x04,0x0255004,0x11,0x02 };
+
+    CHECK( idaunpack32(val) == check );
+
+    // long runs of single byte values, mixed with larger values at every position.
+    for (int ofs=0 ; ofs<40 ; ofs++) {
+        std::string data(ofs, char(0x12));
+        data += std::string("\xff\x12\x34\x56\x78\x81\x23", 7);
+        data += std::string(ofs, char(0x34));
+        data += std::string("\xc0\x00\x40\x00", 4);
+
+        DwordVector expected;
+        idaunpack(data.begin(), data.end(), std::back_inserter(expected));
+        CHECK( idaunpack32(data) == expected );
+    }
+
+    CHECK( idaunpack32("").empty() );
+    CHECK_THROWS( idaunpack32(std::string("\x01\x02\x03\xc0\x00", 5)) );
+
+    std::string words("\x81\x23\xff\xab\xcd\xef\x01\x05\x00", 9);
+    CHECK( idaunpack64(words, true) == (QwordVector{ 0xabcdef0100000123, 5 }) );
+    CHECK( idaunpack64(words, false) == (QwordVector{ 0x123, 0xabcdef01, 5, 0 }) );
+    CHECK_THROWS( idaunpack64(std::string("\x01\x02\x03", 3), true) );
+
+    BulkUnpacker bulk(words, true);
+    CHECK( !bulk.truncated() );
+    CHECK( bulk.remaining() == 4 );
+    CHECK( bulk.nextword() == 0xabcdef0100000123 );
+    CHECK( bulk.next32() == 5 );
+    CHECK( bulk.remaining() == 1 );
+    CHECK( bulk.next32() == 0 );
+    CHECK( bulk.eof() );
+    CHECK_THROWS( bulk.next32() );
+
+    // a truncated value at the end is reported, the values before it are decoded.
+    BulkUnpacker cut(std::string("\x01\x02\x03\xc0\x00", 5), false);
+    CHECK( cut.truncated() );
+    CHECK( cut.remaining() == 3 );
+    CHECK( cut.wordsize() == 1 );
+}
+
+/* sectionstream with various buffer sizes */
+TEST_CASE("test_StreamSection_buffered")
+{
+    for (int bufsize = 1 ; bufsize < 12 ; bufsize++) {
+        auto parent = std::make_shared<std::stringstream>("0123456789abcdef");
+        auto f = makehelper(std::make_shared<sectionstream>(parent, 3, 8, bufsize));
+
+        CHECK( f.getdata(3) == "345" );
+        CHECK( f.getdata(8) == "6789a" );
+        CHECK( f.getdata(8) == "" );
+        f.seekg(-1, std::ios_base::end);
+        CHECK( f.getdata(8) == "a" );
+        f.seekg(3);
+        CHECK( f.getdata(2) == "67" );
+        f.seekg(-2,std::ios_base::cur);
+        CHECK( f.getdata(2) == "67" );
+        f.seekg(2,std::ios_base::cur);
+        CHECK( f.getdata(2) == "a" );
+
+        f.seekg(0);
+        CHECK( f.get8() == '3' );
+        CHECK( f.get16le() == 0x3534 );
+        CHECK( f.get32be() == 0x36373839 );
+        CHECK( f.get8() == 'a' );
+        CHECK_THROWS( f.get8() );
+
+        // other users of the parent stream don't disturb the section.
+        auto is = std::make_shared<sectionstream>(parent, 3, 8, bufsize);
+        char buf[8];
+        is->read(buf, 2);
+        parent->seekg(0);
+        is->read(buf+2, 6);
+        CHECK( std::string(buf, 8) == "3456789a" );
+    }
+}
+
+// v1.5 pages: 16 bit preceeding and pagenr, 8 bit indent, record offsets minus one.
+std::string CreateTestPage15(int pagesize, bool index)
+{
+    std::string page(pagesize, char(0));
+    auto et = EndianTools();
+    auto oi = page.begin();
+    auto od = page.begin() + pagesize/2;
+
+    et.setle16(oi, page.end(), index ? 0x22 : 0); oi += 2;
+    et.setle16(oi, page.end(), 2); oi += 2;
+
+    auto addkv = [&](const std::string& key, const std::string& val, int indent, int pagenr) {
+        if (index) {
+            et.setle16(oi, page.end(), pagenr); oi += 2;
+        }
+        else {
+            et.set8(oi, page.end(), indent); oi += 2;
+        }
+        et.setle16(oi, page.end(), od-page.begin()-1); oi += 2;
+
+        et.setle16(od, page.end(), key.size()-indent); od += 2;
+        std::copy(key.begin()+indent, key.end(), od);  od += key.size()-indent;
+        et.setle16(od, page.end(), val.size()); od += 2;
+        std::copy(val.begin(), val.end(), od);  od += val.size();
+    };
+    addkv("Nabc", "v1", 0, 0x23);
+    addkv("Nabd", "v2", index ? 0 : 3, 0x24);
+
+    return page;
+}
+
+TEST_CASE("TestPage15")
+{
+    auto leaf = std::make_unique<Page15>(std::make_shared<std::stringstream>(CreateTestPage15(1024, false)), 1, 1024);
+    leaf->readindex();
+    CHECK( leaf->isleaf() );
+    CHECK( leaf->getkey(0) == "Nabc" );
+    CHECK( leaf->getkey(1) == "Nabd" );
+    CHECK( leaf->getval(1) == "v2" );
+    CHECK( leaf->find("Nabd") == (BasePage::result{REL_EQUAL,1}) );
+
+    auto index = std::make_unique<Page15>(std::make_shared<std::stringstream>(CreateTestPage15(1024, true)), 2, 1024);
+    index->readindex();
+    CHECK( index->isindex() );
+    CHECK( index->getpage(-1) == 0x22 );
+    CHECK( index->getpage(1) == 0x24 );
+    CHECK( index->getkey(1) == "Nabd" );
+    CHECK( index->getval(0) == "v1" );
+
+    // a truncated page
+    auto shortpage = CreateTestPage15(1024, false).substr(0, 515);
+    auto trunc = std::make_unique<Page15>(std::make_shared<std::stringstream>(shortpage), 3, 1024);
+    CHECK_THROWS( trunc->readindex() );
+}
@@ -0,0 +1,729 @@
+#include "unittestframework.h"
+
+#include <idblib/idb3.h>
+#include <idblib/idbwriter.h>
+#include <map>
+
+// writes `records` as a b-tree, and returns the reader for it.
+std::unique_ptr<BtreeBase> CreateTestBtree(int version, int pagesize, const std::map<std::string, std::string>& records)
+{
+    auto ss = std::make_shared<std::stringstream>();
+    BtreeWriter bw(*ss, version, pagesize);
+    for (auto& kv : records)
+        bw.add(kv.first, kv.second);
+    bw.finish();
+
+    auto bt = MakeBTree(ss);
+    bt->readheader();
+    return bt;
+}
+
+std::map<std::string, std::string> CreateTestRecords(int n)
+{
+    std::map<std::string, std::string> records;
+    for (int i=0 ; i<n ; i++) {
+        char key[32];
+        snprintf(key, sizeof(key), "key%06d", 2*i);  // only even numbers, to be able to search between keys
+        records[key] = std::string(i%37, char('a'+i%26));
+    }
+    return records;
+}
+
+TEST_CASE("test_BtreeWriter")
+{
+    for (int version : { 15, 16, 20 })
+    for (int pagesize : { 256, 2048 })
+    for (int n : { 1, 3, 100, 5000 }) {
+        auto records = CreateTestRecords(n);
+        auto bt = CreateTestBtree(version, pagesize, records);
+
+        CHECK( bt->version() == version );
+
+        // forward scan
+        auto c = bt->find(REL_GREATER_EQUAL, "");
+        auto i = records.begin();
+        while (!c.eof() && i != records.end()) {
+            CHECK( c.getkey() == i->first );
+            CHECK( c.getval() == i->second );
+            CHECK( c.getkeyref() == i->first );
+            CHECK( c.getvalref() == i->second );
+            c.next();
+            ++i;
+        }
+        CHECK( c.eof() );
+        CHECK( i == records.end() );
+
+        // backward scan
+        c = bt->find(REL_LESS_EQUAL, "\xff");
+        auto r = records.rbegin();
+        while (!c.eof() && r != records.rend()) {
+            CHECK( c.getkey() == r->first );
+            c.prev();
+            ++r;
+        }
+        CHECK( c.eof() );
+        CHECK( r == records.rend() );
+
+        if (n < 3)
+            continue;
+        // find with all relations, on and between keys.
+        for (int k=0 ; k<n ; k+=7) {
+            char key[32], between[32];
+            snprintf(key, sizeof(key), "key%06d", 2*k);
+            snprintf(between, sizeof(between), "key%06d", 2*k+1);
+
+            CHECK( bt->find(REL_EQUAL, key).getkey() == key );
+            CHECK( bt->find(REL_EQUAL, between).eof() );
+            CHECK( bt->find(REL_GREATER_EQUAL, key).getkey() == key );
+            CHECK( bt->find(REL_LESS_EQUAL, key).getkey() == key );
+            CHECK( bt->find(REL_LESS_EQUAL, between).getkey() == key );
+            if (k+1<n) {
+                CHECK( bt->find(REL_GREATER, key).getkey() == records.upper_bound(key)->first );
+                CHECK( bt->find(REL_GREATER_EQUAL, between).getkey() == records.upper_bound(key)->first );
+            }
+            if (k>0)
+                CHECK( bt->find(REL_LESS, key).getkey() == std::prev(records.find(key))->first );
+        }
+    }
+}
+
+TEST_CASE("test_BtreeBase_pagecache")
+{
+    auto records = CreateTestRecords(2000);
+    auto bt = CreateTestBtree(20, 256, records);
+    bt->setcachesize(3);
+    for (int round=0 ; round<2 ; round++) {
+        auto c = bt->find(REL_GREATER_EQUAL, "");
+        for (auto& kv : records) {
+            CHECK( c.getkey() == kv.first );
+            c.next();
+        }
+        CHECK( c.eof() );
+        CHECK( bt->find(REL_EQUAL, "key000100").getval() == records["key000100"] );
+    }
+    bt->setcachesize(0);
+    CHECK( bt->find(REL_LESS, "key000100").getkey() == "key000098" );
+}
+
+TEST_CASE("test_BtreeWriter_errors")
+{
+    std::stringstream ss;
+    CHECK_THROWS( BtreeWriter(ss, 17) );
+
+    BtreeWriter bw(ss, 20, 256);
+    bw.add("b", "1");
+    CHECK_THROWS( bw.add("a", "2") );
+    CHECK_THROWS( bw.add("b", "2") );
+    CHECK_THROWS( bw.add("c", std::string(300, 'x')) );
+}
+
+TEST_CASE("test_idapack")
+{
+    std::string packed;
+    std::vector<uint32_t> values = { 0, 1, 0x7f, 0x80, 0x3fff, 0x4000, 0x1fffffff, 0x20000000, 0xffffffff };
+    for (auto v : values)
+        idapack32(packed, v);
+    CHECK( idaunpack32(packed) == DwordVector(values.begin(), values.end()) );
+
+    packed.clear();
+    idapackword(packed, 0x123456789abcdefULL, true);
+    auto words = idaunpack64(packed, true);
+    CHECK( words.size() == 1 );
+    CHECK( words[0] == 0x123456789abcdefULL );
+}
+
+TEST_CASE("test_SyntheticID0")
+{
+    for (uint32_t magic : { IDBFile::MAGIC_IDA1, IDBFile::MAGIC_IDA2 }) {
+        int wordsize = magic==IDBFile::MAGIC_IDA2 ? 8 : 4;
+        SyntheticID0 synth(wordsize, 1000);
+
+        auto ss = std::make_shared<std::stringstream>();
+        BtreeWriter bw(*ss, 20);
+        synth.generate([&](const std::string& key, const std::string& val) { bw.add(key, val); });
+        bw.finish();
+
+        std::string hdr(30, char(0));
+        EndianTools::setle32(hdr.begin(), hdr.end(), magic);
+        IDBFile idb(std::make_shared<std::stringstream>(hdr));
+        ID0File id0(idb, ss);
+
+        for (uint64_t i : { 0, 1, 15, 31, 999 }) {
+            CHECK( id0.getname(synth.address(i)) == synth.name(i) );
+            if (!synth.islongname(i))
+                CHECK( id0.node(synth.name(i)) == synth.address(i) );
+        }
+        CHECK( synth.name(15).size() > 512 );
+
+        CHECK( id0.node("Root Node") == synth.rootnode() );
+        CHECK( id0.node("$ structs") == synth.structlist() );
+
+        uint64_t nstructs = 0;
+        for (auto list = List<Struct>(id0, id0.node("$ structs")) ; !list.eof() ; ) {
+            auto s = list.next();
+            CHECK( s.name() == synth.structname(nstructs) );
+            CHECK( s.nmembers() == SyntheticID0::NSTRUCTMEMBERS );
+            CHECK( s.member(1).name() == "field_000001" );
+            CHECK( s.member(1).offset() == 1 );
+            CHECK( s.seqnr() == nstructs );
+            nstructs++;
+        }
+        CHECK( nstructs == synth.nstructs() );
+
+        auto e = Enum(id0, id0.node(synth.enumname(3)));
+        CHECK( e.count() == SyntheticID0::NENUMMEMBERS );
+        auto c = e.first();
+        CHECK( e.getvalue(c).name() == synth.enummembername(3, 0) );
+    }
+}
+
+TEST_CASE("test_ID0File_scan")
+{
+    CHECK( ID0File::prefixend("abc") == "abd" );
+    CHECK( ID0File::prefixend(std::string("ab\xff\xff", 4)) == "ac" );
+    CHECK( ID0File::prefixend("\xff") == "" );
+
+    SyntheticID0 synth(4, 100);
+    auto ss = std::make_shared<std::stringstream>();
+    BtreeWriter bw(*ss, 20, 1024);
+    synth.generate([&](const std::string& key, const std::string& val) { bw.add(key, val); });
+    bw.finish();
+
+    IDBFile idb(std::make_shared<std::stringstream>(std::string(30, char(0))));
+    ID0File id0(idb, ss);
+
+    // all records of the root node
+    auto prefix = id0.makekey(synth.rootnode());
+    std::vector<std::string> keys;
+    id0.scan(prefix, ID0File::prefixend(prefix), [&](auto& c) {
+        keys.push_back(c.getkey());
+        return true;
+    });
+    CHECK( keys.size() > 1 );
+    CHECK( std::is_sorted(keys.begin(), keys.end()) );
+    for (auto& k : keys)
+        CHECK( k.substr(0, prefix.size()) == prefix );
+    CHECK( id0.find(REL_LESS, prefix).getkey().substr(0, prefix.size()) != prefix );
+
+    std::vector<std::string> rkeys;
+    id0.rscan(prefix, ID0File::prefixend(prefix), [&](auto& c) {
+        rkeys.push_back(c.getkey());
+        return true;
+    });
+    CHECK( std::equal(keys.begin(), keys.end(), rkeys.rbegin(), rkeys.rend()) );
+
+    // stop early
+    int n = 0;
+    id0.scan("", "", [&](auto& c) { return ++n < 10; });
+    CHECK( n == 10 );
+
+    // index ranges are half open
+    auto lo = id0.makekey(synth.rootnode(), 'S', 0);
+    auto hi = id0.makekey(synth.rootnode(), 'S', 0x41b994);
+    id0.scan(lo, hi, [&](auto& c) {
+        CHECK( c.getkey() < hi );
+        return true;
+    });
+}
+
+TEST_CASE("test_ID0File_try")
+{
+    SyntheticID0 synth(4, 200);
+    auto ss = std::make_shared<std::stringstream>();
+    BtreeWriter bw(*ss, 20, 1024);
+    synth.generate([&](const std::string& key, const std::string& val) { bw.add(key, val); });
+    bw.finish();
+
+    IDBFile idb(std::make_shared<std::stringstream>(std::string(30, char(0))));
+    ID0File id0(idb, ss);
+
+    uint64_t root = synth.rootnode();
+    CHECK( id0.tryfind(root, 'N') );
+    CHECK( !id0.tryfind(root, 'N', 1234) );
+    CHECK( !id0.trygetdata(root, 'X', 1) );
+    CHECK( id0.trygetdata(root, 'N') );
+    CHECK( !id0.trygetuint(root, 'X', 1) );
+    CHECK( NodeValues::trygetuint("abc") == std::nullopt );
+    CHECK( NodeValues::trygetuint("ab") == 0x6261 );
+
+    // a cursor past the last record
+    auto c = id0.find(REL_GREATER, "\xff\xff\xff\xff");
+    CHECK( c.eof() );
+    CHECK( !c.trygetkey() );
+    CHECK( !c.trygetval() );
+    c = id0.find(REL_EQUAL, id0.makekey(root, 'N'));
+    CHECK( c.trygetkey() == id0.makekey(root, 'N') );
+
+    // enumlist stops at the end of the tag, the 'A' list also has the size at index -1.
+    uint64_t n = 0;
+    id0.enumlist(synth.structlist(), 'A', [&](uint64_t) { n++; });
+    CHECK( n == synth.nstructs()+1 );
+
+    CHECK( id0.node(std::string(1000, 'x')) == 0 );
+
+    CHECK( Struct::tryload(id0, synth.structlist()+1000) == std::nullopt );
+    CHECK_THROWS( Struct(id0, synth.structlist()+1000) );
+    auto s = Struct::tryload(id0, id0.node(synth.structname(1)));
+    REQUIRE( s );
+    CHECK( s->nmembers() == SyntheticID0::NSTRUCTMEMBERS );
+}
+
+TEST_CASE("test_XrefGraph")
+{
+    NodeKeys nk(4);
+    std::map<std::string, std::string> records;
+    auto addxref = [&](uint64_t from, uint64_t to, char kind, char reftype) {
+        records[nk.make_node_key<std::string>(from, kind, to)] = std::string(1, reftype);
+        records[nk.make_node_key<std::string>(to, kind=='x' ? 'X' : 'D', from)] = std::string(1, reftype);
+    };
+    addxref(0x1000, 0x2000, 'x', 17);
+    addxref(0x1000, 0x3000, 'x', 17);
+    addxref(0x1000, 0x8000, 'd', 3);
+    addxref(0x2000, 0x1000, 'x', 19);
+    addxref(0x4000, 0x8004, 'd', 2);
+    records[nk.make_node_key<std::string>(0x1000, 'N')] = "main";
+    records[nk.make_node_key<std::string>(0xFF000001, 'x', 0x1000)] = "\x11";   // not an address node
+
+    auto ss = std::make_shared<std::stringstream>();
+    BtreeWriter bw(*ss, 20, 256);
+    for (auto& kv : records)
+        bw.add(kv.first, kv.second);
+    bw.finish();
+    IDBFile idb(std::make_shared<std::stringstream>(std::string(30, char(0))));
+    ID0File id0(idb, ss);
+
+    auto g = XrefGraph::load(id0);
+    CHECK( g.sources == std::vector<uint64_t>{ 0x1000, 0x2000, 0x4000 } );
+    CHECK( g.offsets == std::vector<uint64_t>{ 0, 3, 4, 5 } );
+    CHECK( g.nedges() == 5 );
+
+    auto e = g.edges(0x1000);
+    CHECK( e.second - e.first == 3 );
+    // 'd' sorts before 'x'
+    CHECK( g.targets[e.first] == 0x8000 );
+    CHECK( g.kinds[e.first] == 'd' );
+    CHECK( g.reftypes[e.first] == 3 );
+    CHECK( g.targets[e.first+1] == 0x2000 );
+    CHECK( g.kinds[e.first+1] == 'x' );
+
+    e = g.edges(0x3000);
+    CHECK( e.first == e.second );
+}
+
+TEST_CASE("test_ID0File_partition")
+{
+    SyntheticID0 synth(4, 3000);
+    auto ss = std::make_shared<std::stringstream>();
+    BtreeWriter bw(*ss, 20, 1024);
+    synth.generate([&](const std::string& key, const std::string& val) { bw.add(key, val); });
+    bw.finish();
+    std::string data = ss->str();
+
+    IDBFile idb(std::make_shared<std::stringstream>(std::string(30, char(0))));
+    ID0File id0(idb, ss);
+
+    std::vector<std::string> keys;
+    id0.scan("", "", [&](auto& c) { keys.push_back(c.getkey()); return true; });
+
+    for (size_t n : { 1, 2, 7, 32 }) {
+        auto parts = id0.partition("", "", n);
+        CHECK( parts.size() <= n );
+        CHECK( parts.front().first == "" );
+        CHECK( parts.back().second == "" );
+        for (size_t i=1 ; i<parts.size() ; i++) {
+            CHECK( parts[i-1].second == parts[i].first );
+            CHECK( parts[i].first < parts[i].second + (parts[i].second.empty() ? "\xff" : "") );
+        }
+        std::vector<std::string> partkeys;
+        for (auto& p : parts)
+            id0.scan(p.first, p.second, [&](auto& c) { partkeys.push_back(c.getkey()); return true; });
+        CHECK( partkeys == keys );
+    }
+    CHECK( id0.partition("", "", 8).size() == 8 );
+
+    // a subrange
+    auto lo = id0.makekey(synth.address(100));
+    auto hi = id0.makekey(synth.address(2000));
+    auto parts = id0.partition(lo, hi, 4);
+    CHECK( parts.size() > 1 );
+    CHECK( parts.front().first == lo );
+    CHECK( parts.back().second == hi );
+
+    // parallel scan, each thread reads its own copy of the b-tree
+    parts = id0.partition("", "", 16);
+    std::vector<std::vector<std::string>> results(parts.size());
+    std::atomic<int> opened(0);
+    parallelscan(parts, [&]() {
+        opened++;
+        return std::make_unique<ID0File>(idb, std::make_shared<std::stringstream>(data));
+    }, 4, [&](size_t part, BtreeBase::Cursor& c) {
+        results[part].push_back(c.getkey());
+        return true;
+    });
+    CHECK( opened == 4 );
+    std::vector<std::string> all;
+    for (auto& r : results)
+        all.insert(all.end(), r.begin(), r.end());
+    CHECK( all == keys );
+
+    CHECK_THROWS( parallelscan(parts, [&]() -> std::unique_ptr<ID0File> { throw "open failed"; }, 4, [](size_t, BtreeBase::Cursor&) { return true; }) );
+}
+
+TEST_CASE("test_XrefGraph_parallel")
+{
+    NodeKeys nk(4);
+    std::map<std::string, std::string> records;
+    for (uint64_t ea=0x1000 ; ea<0x3000 ; ea+=4) {
+        records[nk.make_node_key<std::string>(ea, 'N')] = "name";
+        for (int i=0 ; i<3 ; i++)
+            records[nk.make_node_key<std::string>(ea, i ? 'x' : 'd', ea+0x100*(i+1))] = std::string(1, char(i));
+    }
+    auto ss = std::make_shared<std::stringstream>();
+    BtreeWriter bw(*ss, 20, 512);
+    for (auto& kv : records)
+        bw.add(kv.first, kv.second);
+    bw.finish();
+    std::string data = ss->str();
+    IDBFile idb(std::make_shared<std::stringstream>(std::string(30, char(0))));
+    ID0File id0(idb, ss);
+
+    // with records of equal size, the parts have about the same number of records.
+    auto parts = id0.partition("", "", 8);
+    CHECK( parts.size() == 8 );
+    for (auto& p : parts) {
+        size_t count = 0;
+        id0.scan(p.first, p.second, [&](auto&) { count++; return true; });
+        CHECK( count > records.size()/16 );
+    }
+
+    auto g = XrefGraph::load(id0);
+    CHECK( g.sources.size() == 0x800 );
+    CHECK( g.nedges() == 3*0x800 );
+    for (int nthreads : { 1, 3 }) {
+        auto pg = XrefGraph::load(id0, [&]() {
+            return std::make_unique<ID0File>(idb, std::make_shared<std::stringstream>(data));
+        }, nthreads);
+        CHECK( pg.sources == g.sources );
+        CHECK( pg.offsets == g.offsets );
+        CHECK( pg.targets == g.targets );
+        CHECK( pg.kinds == g.kinds );
+        CHECK( pg.reftypes == g.reftypes );
+    }
+}
+
+TEST_CASE("test_ID0File_estimate")
+{
+    NodeKeys nk(4);
+    std::map<std::string, std::string> records;
+    for (uint64_t ea=0x1000 ; ea<0x5000 ; ea+=4) {
+        records[nk.make_node_key<std::string>(ea, 'N')] = "name";
+        for (int i=0 ; i<3 ; i++)
+            records[nk.make_node_key<std::string>(ea, 'x', ea+0x100*(i+1))] = std::string(1, char(i));
+    }
+    auto ss = std::make_shared<std::stringstream>();
+    BtreeWriter bw(*ss, 20, 512);
+    for (auto& kv : records)
+        bw.add(kv.first, kv.second);
+    bw.finish();
+    IDBFile idb(std::make_shared<std::stringstream>(std::string(30, char(0))));
+    ID0File id0(idb, ss);
+
+    auto count = [&](const std::string& lo, const std::string& hi) {
+        uint64_t n = 0;
+        id0.scan(lo, hi, [&](auto&) { n++; return true; });
+        return n;
+    };
+    // with records of equal size, the estimate is within a few percent, plus a leaf at each end.
+    auto all = id0.estimate("", "");
+    CHECK( all.records > records.size()*9/10 );
+    CHECK( all.records <= records.size() );
+    uint64_t perleaf = records.size() / all.pages;
+    for (auto [a, b] : std::vector<std::pair<uint64_t, uint64_t>>{ {0x1000, 0x1100}, {0x1234, 0x3456}, {0x2000, 0x5000}, {0x4ff0, 0x5000} }) {
+        auto lo = id0.makekey(a);
+        auto hi = id0.makekey(b);
+        auto est = id0.estimate(lo, hi);
+        auto n = count(lo, hi);
+        CHECK( est.records + n/10 + perleaf >= n );
+        CHECK( est.records <= n + n/10 + perleaf );
+        CHECK( est.pages >= 1 );
+    }
+    CHECK( id0.estimate(id0.makekey(0x2000), "").records > count(id0.makekey(0x2000), "")*9/10 );
+
+    // a range within one leaf is counted from that leaf.
+    auto leafest = id0.estimate(id0.makekey(0x2004), id0.makekey(0x200c));
+    CHECK( leafest.pages == 1 );
+    CHECK( leafest.records == count(id0.makekey(0x2004), id0.makekey(0x200c)) );
+    CHECK( leafest.records == 8 );
+
+    // empty ranges
+    CHECK( id0.estimate(id0.makekey(0x2000), id0.makekey(0x2000)).records == 0 );
+    CHECK( id0.estimate(id0.makekey(0x3000), id0.makekey(0x2000)).records == 0 );
+
+    // a single page b-tree is counted exactly
+    auto small = std::make_shared<std::stringstream>();
+    BtreeWriter sw(*small, 20, 0x2000);
+    for (uint64_t ea=0x1000 ; ea<0x1100 ; ea+=4)
+        sw.add(nk.make_node_key<std::string>(ea, 'N'), "name");
+    sw.finish();
+    ID0File sid0(idb, small);
+    CHECK( sid0.estimate("", "").records == 0x40 );
+    CHECK( sid0.estimate(sid0.makekey(0x1010), sid0.makekey(0x1020)).records == 4 );
+    CHECK( sid0.estimate(sid0.makekey(0x1010), "").records == 0x3c );
+}
+
+TEST_CASE("test_FunctionIndex")
+{
+    for (int wordsize : { 4, 8 }) {
+        bool use64 = wordsize==8;
+        NodeKeys nk(wordsize);
+        uint64_t nodebase = use64 ? 0xFF00000000000000 : 0xFF000000;
+        uint64_t funcsnode = nodebase + 5;
+        std::map<std::string, std::string> records;
+
+        auto addfunc = [&](uint64_t start, uint64_t end, uint16_t flags, uint64_t owner) {
+            std::string spec;
+            idapackword(spec, start, use64);
+            idapackword(spec, end-start, use64);
+            idapack16(spec, flags);
+            if (flags & Function::FUNC_TAIL) {
+                idapackword(spec, start-owner, use64);
+                idapack32(spec, 1);
+            }
+            else {
+                idapackword(spec, 0, use64);
+                idapackword(spec, 0x10, use64);
+                idapack16(spec, 4);
+                idapackword(spec, 8, use64);
+            }
+            records[nk.make_node_key<std::string>(funcsnode, 'S', start)] = spec;
+        };
+        addfunc(0x1000, 0x1100, 0x400, 0);
+        addfunc(0x1100, 0x1180, 0x10, 0);
+        addfunc(0x2000, 0x2020, Function::FUNC_TAIL, 0x1000);
+        addfunc(0x3000, 0x3400, 0x4410, 0);
+        records[nk.make_name_key<std::string>("$ funcs")] = std::string((char*)&funcsnode, wordsize);
+        records[nk.make_node_key<std::string>(0x1000, 'N')] = "main";
+
+        auto ss = std::make_shared<std::stringstream>();
+        BtreeWriter bw(*ss, 20, 256);
+        for (auto& kv : records)
+            bw.add(kv.first, kv.second);
+        bw.finish();
+        std::string hdr(30, char(0));
+        EndianTools::setle32(hdr.begin(), hdr.end(), use64 ? IDBFile::MAGIC_IDA2 : IDBFile::MAGIC_IDA1);
+        IDBFile idb(std::make_shared<std::stringstream>(hdr));
+        ID0File id0(idb, ss);
+
+        Function f(id0, 0x2000);
+        CHECK( f.istail() );
+        CHECK( f.owner() == 0x1000 );
+        CHECK( f.end() == 0x2020 );
+        CHECK( f.name() == "main" );
+        CHECK( Function(id0, 0x3000).flags() == 0x4410 );
+        CHECK_THROWS( Function(id0, 0x3001) );
+
+        FunctionIndex funcs(id0);
+        CHECK( funcs.size() == 3 );
+        CHECK( funcs.nchunks() == 4 );
+        CHECK( funcs.find(0x0fff) == BADADDR );
+        CHECK( funcs.find(0x1000) == 0x1000 );
+        CHECK( funcs.find(0x10ff) == 0x1000 );
+        CHECK( funcs.find(0x1100) == 0x1100 );
+        CHECK( funcs.find(0x1180) == BADADDR );
+        CHECK( funcs.find(0x2010) == 0x1000 );
+        CHECK( funcs.find(0x33ff) == 0x3000 );
+        CHECK( funcs.find(0x3400) == BADADDR );
+    }
+}
+
+TEST_CASE("test_SegmentTable")
+{
+    NodeKeys nk(4);
+    uint32_t segsnode = 0xFF000010, stringsnode = 0xFF000011;
+    std::map<std::string, std::string> records;
+    auto addseg = [&](uint32_t start, uint32_t end, uint32_t name, uint32_t sclass, uint32_t perm) {
+        std::string spec;
+        for (uint32_t v : { start, end-start, name, sclass, 0u, 0x10u, 3u, 2u, perm, 1u, 2u, 1u })
+            idapack32(spec, v);
+        records[nk.make_node_key<std::string>(segsnode, 'S', start)] = spec;
+    };
+    addseg(0x401000, 0x402000, 1, 2, 5);
+    addseg(0x402000, 0x403000, 3, 4, 6);
+
+    std::string strings;
+    idapack32(strings, 1);
+    idapack32(strings, 5);
+    for (std::string str : { ".text", "CODE", ".data", "DATA" }) {
+        idapack32(strings, str.size());
+        strings += str;
+    }
+    records[nk.make_node_key<std::string>(stringsnode, 'S', 0)] = strings;
+    records[nk.make_name_key<std::string>("$ segs")] = std::string((char*)&segsnode, 4);
+    records[nk.make_name_key<std::string>("$ segstrings")] = std::string((char*)&stringsnode, 4);
+
+    auto ss = std::make_shared<std::stringstream>();
+    BtreeWriter bw(*ss, 20, 256);
+    for (auto& kv : records)
+        bw.add(kv.first, kv.second);
+    bw.finish();
+
+    // an id1 section without segments.
+    auto id1data = std::make_shared<std::stringstream>();
+    writeid1section(*id1data, {}, 4, [](uint64_t) { return 0; });
+    IDBFile idb(std::make_shared<std::stringstream>(std::string(30, char(0))));
+    ID0File id0(idb, ss);
+    ID1File id1(idb, id1data);
+
+    SegmentTable segs(id0, id1);
+    CHECK( segs.hasattributes() );
+    CHECK( segs.size() == 2 );
+    CHECK( segs.find(0x400fff) == nullptr );
+    CHECK( segs.find(0x403000) == nullptr );
+    auto seg = segs.find(0x401234);
+    REQUIRE( seg != nullptr );
+    CHECK( seg->start == 0x401000 );
+    CHECK( seg->end == 0x402000 );
+    CHECK( seg->name == ".text" );
+    CHECK( seg->sclass == "CODE" );
+    CHECK( seg->perm == 5 );
+    CHECK( seg->bitness == 1 );
+    CHECK( segs.find(0x402000)->name == ".data" );
+    CHECK( segs.find(0x402fff)->sclass == "DATA" );
+}
+
+TEST_CASE("test_TILFile")
+{
+    auto le32 = [](std::string& out, uint32_t v) {
+        for (int i=0 ; i<4 ; i++)
+            out += char(v>>(8*i));
+    };
+    auto entry = [&](std::string& bucket, const std::string& name, int ordinal, const std::string& type, const std::string& cmt) {
+        le32(bucket, 0);
+        bucket += name + '\0';
+        if (ordinal >= 0)
+            le32(bucket, ordinal);
+        bucket += type + '\0';
+        bucket += std::string("f1") + '\0';
+        bucket += cmt + '\0';
+        bucket += '\0';
+        bucket += char(1);
+    };
+    std::string syms, types;
+    entry(syms, "errno", -1, "\x07", "");
+    for (int i=1 ; i<=100 ; i++)
+        entry(types, stringformat("type%d", i), i, std::string(i%7+1, char(0x0d)), stringformat("comment %d", i));
+
+    std::string til = "IDATIL";
+    le32(til, 0x12);
+    le32(til, TILFile::TIL_ESI | TILFile::TIL_ORD);
+    til += char(4); til += "test";
+    til += char(0);
+    til += std::string("\x00\x13\x04\x01\x04\x00", 6);
+    til += std::string("\x02\x04\x08", 3);
+    le32(til, 1);  le32(til, syms.size());  til += syms;
+    le32(til, 101);
+    le32(til, 100);  le32(til, types.size());  til += types;
+
+    auto ss = std::make_shared<std::stringstream>();
+    IDBWriter w(*ss, IDBFile::MAGIC_IDA1);
+    w.beginsection(TILFile::INDEX);
+    ss->write(til.data(), til.size());
+    w.endsection();
+    w.finish();
+
+    IDBFile idb(ss);
+    CHECK( !idb.hassection(ID0File::INDEX) );
+    REQUIRE( idb.hassection(TILFile::INDEX) );
+    TILFile tf(idb.getsection(TILFile::INDEX));
+    CHECK( tf.title() == "test" );
+    CHECK( tf.base() == "" );
+    CHECK( tf.nordinals() == 101 );
+    CHECK( tf.count(TILFile::SYMBOLS) == 1 );
+    CHECK( tf.count(TILFile::TYPES) == 100 );
+    CHECK( tf.count(TILFile::MACROS) == 0 );
+    CHECK_THROWS( tf.contains(TILFile::MACROS, "x") );
+
+    CHECK( tf.contains(TILFile::TYPES, "type37") );
+    CHECK( !tf.contains(TILFile::TYPES, "type101") );
+    CHECK( tf.names(TILFile::TYPES).size() == 100 );
+    auto e = tf.gettype("type37");
+    CHECK( e.name == "type37" );
+    CHECK( e.ordinal == 37 );
+    CHECK( e.type == std::string(3, char(0x0d)) );
+    CHECK( e.fields == "f1" );
+    CHECK( e.comment == "comment 37" );
+    CHECK( e.sclass == 1 );
+    CHECK( tf.getsymbol("errno").type == "\x07" );
+    CHECK_THROWS( tf.gettype("errno") );
+
+    // named type references, as found in struct member typeinfo
+    CHECK( TILFile::typedefname("\x3d\x07type37") == "type37" );
+    CHECK( TILFile::typedefname("\x0a\x3d\x07type37") == "type37" );
+    CHECK( TILFile::typedefname("\x3d\x07type3") == "" );
+    CHECK( TILFile::typedefname("\x3d\x03#1") == "" );
+    CHECK( TILFile::typedefname("\x07") == "" );
+    CHECK( TILFile::typedefname("") == "" );
+    REQUIRE( tf.resolve("\x0a\x3d\x07type37") );
+    CHECK( tf.resolve("\x0a\x3d\x07type37")->ordinal == 37 );
+    CHECK( !tf.resolve("\x3d\x08type101") );
+}
+
+TEST_CASE("test_IDBWriter")
+{
+    for (uint32_t magic : { IDBFile::MAGIC_IDA1, IDBFile::MAGIC_IDA2 }) {
+        int wordsize = magic==IDBFile::MAGIC_IDA2 ? 8 : 4;
+        SyntheticID0 synth(wordsize, 300);
+
+        auto ss = std::make_shared<std::stringstream>();
+        IDBWriter w(*ss, magic);
+
+        w.beginsection(ID0File::INDEX);
+        BtreeWriter bw(*ss, 20);
+        synth.generate([&](const std::string& key, const std::string& val) { bw.add(key, val); });
+        bw.finish();
+        w.endsection();
+
+        w.beginsection(ID1File::INDEX);
+        writeid1section(*ss, synth.segments(), wordsize, [&](uint64_t ea) { return synth.flags(ea); });
+        w.endsection();
+
+        w.beginsection(NAMFile::INDEX);
+        writenamsection(*ss, synth.nnames(), wordsize, [&](uint64_t i) { return synth.address(i); });
+        w.endsection();
+        w.finish();
+
+        IDBFile idb(ss);
+        CHECK( idb.magic() == magic );
+        ID0File id0(idb, idb.getsection(ID0File::INDEX));
+        ID1File id1(idb, idb.getsection(ID1File::INDEX));
+        NAMFile nam(idb, idb.getsection(NAMFile::INDEX));
+
+        CHECK( id0.getname(synth.address(17)) == synth.name(17) );
+        CHECK( id0.getname(synth.address(15)) == synth.name(15) );
+
+        CHECK( id1.FirstSeg() == synth.address(0) );
+        CHECK( id1.SegEnd(synth.address(5)) == synth.address(300) );
+        CHECK( id1.GetFlags(synth.address(5)) == synth.flags(synth.address(5)) );
+        CHECK( id1.GetFlags(synth.address(5)+3) == synth.flags(synth.address(5)+3) );
+
+        CHECK( nam.numnames() == 300 );
+        CHECK( nam.findname(synth.address(7)+5) == synth.address(7) );
+    }
+}
+
+#ifdef IDB_WITH_STATS
+TEST_CASE("test_IdbStats")
+{
+    auto bt = CreateTestBtree(20, 256, CreateTestRecords(1000));
+    idbstats().reset();
+
+    auto c = bt->find(REL_GREATER_EQUAL, "key000100");
+    c.next();
+    c.next();
+    CHECK( idbstats().finds[REL_GREATER_EQUAL] == 1 );
+    CHECK( idbstats().finds[REL_EQUAL] == 0 );
+    CHECK( idbstats().cursorsteps == 2 );
+    CHECK( idbstats().pagesread >= 2 );
+    CHECK( idbstats().bytesread >= idbstats().pagesread*256 );
+}
+#endif
@@ -0,0 +1,166 @@
+/*
+ * columnwriter.h: writes tables in a simple columnar binary format.
+ *
+ * Author: Willem Hengeveld <itsme@xs4all.nl>
+ *
+ * Rows are collected per column, and written in row groups, so a reader
+ * can load a single column of a group with one read, without parsing
+ * the other columns.
+ *
+ *    ColumnWriter cw(os, "source=x.idb\n");
+ *    int k = cw.addcolumn("key", ColumnWriter::BINARY);
+ *    int n = cw.addcolumn("nodeid", ColumnWriter::U64);
+ *    cw.set(k, "abc");  cw.set(n, 1234);  cw.endrow();
+ *    cw.finish();
+ *
+ * File layout, all integers are little endian:
+ *
+ *    char[8]   magic         "IDBCOLS1"
+ *    uint32    metasize
+ *    char[]    metadata      free form "name=value\n" lines
+ *
+ *    row groups:
+ *      uint32  nrows         a group with nrows=0 marks the end of the file
+ *      uint32  ncolumns
+ *      per column:
+ *        uint8   namesize
+ *        char[]  name
+ *        uint8   type        1 = U8, 2 = U64, 3 = BINARY
+ *        uint64  datasize
+ *        data:
+ *           U8:     nrows bytes
+ *           U64:    nrows uint64 values
+ *           BINARY: (nrows+1) uint32 offsets, followed by the concatenated values
+ *
+ * Within a group, offsets of BINARY columns are relative to the start of the value bytes.
+ */
+#pragma once
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+class ColumnWriter {
+public:
+    enum coltype_t { U8 = 1, U64 = 2, BINARY = 3 };
+private:
+    struct column {
+        std::string name;
+        coltype_t type;
+        std::string data;
+        std::vector<uint32_t> offsets;    // for BINARY columns
+        uint32_t nvalues = 0;
+    };
+    std::ostream& _os;
+    std::vector<column> _columns;
+    uint32_t _rowspergroup;
+    uint32_t _nrows;
+    uint64_t _totalrows;
+
+    template<typename T>
+    void put(std::string& buf, T v)
+    {
+        for (unsigned i=0 ; i<sizeof(T) ; i++) {
+            buf += char(v);
+            v >>= 8;
+        }
+    }
+    void writegroup()
+    {
+        std::string hdr;
+        put<uint32_t>(hdr, _nrows);
+        put<uint32_t>(hdr, _columns.size());
+        _os.write(hdr.data(), hdr.size());
+
+        for (auto& col : _columns) {
+            if (col.nvalues != _nrows)
+                throw "columnwriter: incomplete row";
+            std::string offsets;
+            if (col.type == BINARY)
+                for (auto ofs : col.offsets)
+                    put<uint32_t>(offsets, ofs);
+
+            hdr.clear();
+            put<uint8_t>(hdr, col.name.size());
+            hdr += col.name;
+            put<uint8_t>(hdr, col.type);
+            put<uint64_t>(hdr, offsets.size() + col.data.size());
+            _os.write(hdr.data(), hdr.size());
+            _os.write(offsets.data(), offsets.size());
+            _os.write(col.data.data(), col.data.size());
+
+            col.data.clear();
+            col.offsets.assign(1, 0);
+            col.nvalues = 0;
+        }
+        _nrows = 0;
+    }
+public:
+    ColumnWriter(std::ostream& os, const std::string& metadata, uint32_t rowspergroup = 0x10000)
+        : _os(os), _rowspergroup(rowspergroup), _nrows(0), _totalrows(0)
+    {
+        std::string hdr = "IDBCOLS1";
+        put<uint32_t>(hdr, metadata.size());
+        hdr += metadata;
+        _os.write(hdr.data(), hdr.size());
+    }
+
+    // columns must be added before the first row.
+    int addcolumn(const std::string& name, coltype_t type)
+    {
+        if (_nrows || _totalrows)
+            throw "columnwriter: columns must be added before the first row";
+        if (name.size() > 255)
+            throw "columnwriter: column name too long";
+        _columns.emplace_back();
+        auto& col = _columns.back();
+        col.name = name;
+        col.type = type;
+        col.offsets.assign(1, 0);
+        return _columns.size()-1;
+    }
+
+    void set(int ci, uint64_t value)
+    {
+        auto& col = _columns[ci];
+        if (col.type == U8)
+            put<uint8_t>(col.data, value);
+        else if (col.type == U64)
+            put<uint64_t>(col.data, value);
+        else
+            throw "columnwriter: not a numeric column";
+        col.nvalues++;
+    }
+    void set(int ci, std::string_view value)
+    {
+        auto& col = _columns[ci];
+        if (col.type != BINARY)
+            throw "columnwriter: not a binary column";
+        col.data += value;
+        if (col.data.size() > 0xFFFFFFFF)
+            throw "columnwriter: row group too large";
+        col.offsets.push_back(col.data.size());
+        col.nvalues++;
+    }
+    void endrow()
+    {
+        _nrows++;
+        _totalrows++;
+        if (_nrows == _rowspergroup)
+            writegroup();
+    }
+
+    // writes the last group, and the end marker, returns the number of rows written.
+    uint64_t finish()
+    {
+        if (_nrows)
+            writegroup();
+        std::string end;
+        put<uint32_t>(end, 0);
+        put<uint32_t>(end, 0);
+        _os.write(end.data(), end.size());
+        _os.flush();
+        return _totalrows;
+    }
+};
@@ -0,0 +1,114 @@
+/*
+ * idbgen: generates a synthetic idb or i64 database, for load testing idblib.
+ *
+ * Author: Willem Hengeveld <itsme@xs4all.nl>
+ *
+ * The database contains an id0 b-tree with names, long names, structs and enums,
+ * an id1 section with the flags, and a nam section with the named addresses.
+ */
+#include <fstream>
+#include <iostream>
+#include <chrono>
+#include <idblib/idb3.h>
+#include <idblib/idbwriter.h>
+#include <cpputils/argparse.h>
+#include <cpputils/formatter.h>
+
+void usage()
+{
+    printf("idbgen OPTIONS <outputfile>\n");
+    printf("    -n | --names N      nr of named addresses, default 1000000\n");
+    printf("    -6 | --i64          create a 64 bit database\n");
+    printf("    -p | --pagesize N   b-tree pagesize, default 0x2000\n");
+    printf("    -b | --btree VER    b-tree version: 15, 16 or 20, default 20\n");
+    printf("about 175 bytes are written per name.\n");
+}
+
+void generateidb(const std::string& fn, uint64_t nnames, bool use64, int btreeversion, int pagesize)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    int wordsize = use64 ? 8 : 4;
+    SyntheticID0 synth(wordsize, nnames);
+    if (synth.address(nnames) > 0xFFFFFFFF)
+        throw "idbgen: too many names";
+
+    std::ofstream os(fn, std::ios::binary | std::ios::trunc);
+    if (!os)
+        throw "idbgen: can't create output file";
+
+    IDBWriter idb(os, use64 ? IDBFile::MAGIC_IDA2 : IDBFile::MAGIC_IDA1);
+
+    idb.beginsection(ID0File::INDEX);
+    BtreeWriter bt(os, btreeversion, pagesize);
+    uint64_t nrecs = 0;
+    synth.generate([&](const std::string& key, const std::string& val) {
+        bt.add(key, val);
+        nrecs++;
+    });
+    uint64_t id0size = bt.finish();
+    idb.endsection();
+
+    idb.beginsection(ID1File::INDEX);
+    uint64_t id1size = writeid1section(os, synth.segments(), wordsize, [&](uint64_t ea) { return synth.flags(ea); });
+    idb.endsection();
+
+    idb.beginsection(NAMFile::INDEX);
+    uint64_t namsize = writenamsection(os, nnames, wordsize, [&](uint64_t i) { return synth.address(i); });
+    idb.endsection();
+
+    idb.finish();
+    if (!os)
+        throw "idbgen: error writing output";
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - t0;
+    print("%s: %d names, %d structs, %d enums, %d records\n", fn, nnames, synth.nstructs(), synth.nenums(), nrecs);
+    print("id0: %d bytes, id1: %d bytes, nam: %d bytes, in %.1f seconds\n", id0size, id1size, namsize, elapsed.count());
+}
+
+int main(int argc, char**argv)
+{
+    std::string outname;
+    uint64_t nnames = 1000000;
+    bool use64 = false;
+    int btreeversion = 20;
+    int pagesize = 0x2000;
+
+    for (auto& arg : ArgParser(argc, argv))
+        switch (arg.option())
+        {
+            case 'n': nnames = arg.getint(); break;
+            case '6': use64 = true; break;
+            case 'p': pagesize = arg.getint(); break;
+            case 'b': btreeversion = arg.getint(); break;
+            case '-': if (arg.match("--names")) nnames = arg.getint();
+                      else if (arg.match("--i64")) use64 = true;
+                      else if (arg.match("--pagesize")) pagesize = arg.getint();
+                      else if (arg.match("--btree")) btreeversion = arg.getint();
+                      else {
+                          usage();
+                          return 1;
+                      }
+                      break;
+            case -1: outname = arg.getstr(); break;
+            default:
+                      usage();
+                      return 1;
+        }
+    if (outname.empty()) {
+        usage();
+        return 1;
+    }
+
+    try {
+        generateidb(outname, nnames, use64, btreeversion, pagesize);
+    }
+    catch(const std::exception & e) {
+        print("EXCEPTION: %s\n", e.what());
+        return 1;
+    }
+    catch(const char * msg) {
+        print("ERROR: %s\n", msg);
+        return 1;
+    }
+    return 0;
+}
@@ -9,8 +9,21 @@
 #include <memory>
 #include <algorithm>
 #include <climits>
+#include <chrono>
+#ifndef _WIN32
+#include <thread>
+#include <mutex>
+#include <csignal>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include <idblib/idb3.h>
 #include <cpputils/argparse.h>
+#include "jsonwriter.h"
+#include "columnwriter.h"
 
 #ifdef HAVE_LIBGMP
 #include <gmpxx.h>
@@ -19,6 +32,45 @@
 #include <cpputils/stringlibrary.h>
 
 int verbose = 0;
+// set with --threads: the number of threads used by the extractors which support it.
+int nthreads = 1;
+
+// set with --format=ndjson: all output is written as one json object per line.
+thread_local JsonWriter *ndjson = nullptr;
+
+// when set, the text output is collected here instead of printed,
+// used by the serve mode.
+thread_local std::string *outbuf = nullptr;
+
+template<typename...ARGS>
+void output(const char *fmt, ARGS&&...args)
+{
+    if (outbuf)
+        *outbuf += stringformat(fmt, std::forward<ARGS>(args)...);
+    else
+        print(fmt, std::forward<ARGS>(args)...);
+}
+
+// returns a function opening the id0 section of `dbname`,
+// for parallelscan: each thread opens its own copy.
+auto id0opener(const std::string& dbname)
+{
+    return [dbname]() {
+        IDBFile idb(std::make_shared<std::ifstream>(dbname, std::ios::binary));
+        return std::make_unique<ID0File>(idb, idb.getsection(ID0File::INDEX));
+    };
+}
+
+// also drops a record left unfinished by the error.
+void jsonerror(const std::string& msg)
+{
+    ndjson->reset();
+    ndjson->beginobject();
+    ndjson->field("type", "error");
+    ndjson->field("message", msg);
+    ndjson->endobject();
+    ndjson->newline();
+}
 
 #ifdef HAVE_LIBGMP
 /*
@@ -54,8 +106,13 @@ inline std::string mpztoms(int requiredbytes, const mpz_class& m)
     int nails= 0;   // all bits used
     int order= ORDER_MS_FIRST;
 
-    if (m<0)
-        print("PROBLEM: can't convert negative mpz to bytes\n");
+    // this is called while the ndjson info record is written, so warn on stderr there.
+    if (m<0) {
+        if (ndjson)
+            fprint(stderr, "PROBLEM: can't convert negative mpz to bytes\n");
+        else
+            output("PROBLEM: can't convert negative mpz to bytes\n");
+    }
 
     size_t n= mpz_sizeinbase(m.get_mpz_t(), 256);
     if (requiredbytes==0)
@@ -88,38 +145,119 @@ std::string decryptuser(const std::string& encvector)
 /*
  *  dump structs + unions
  */
-void dumpstructmember(const StructMember& mem)
+
+// the type library, opened when a struct member first refers to a named type.
+class LazyTIL {
+    IDBFile& _idb;
+    std::unique_ptr<TILFile> _til;
+    bool _opened = false;
+public:
+    LazyTIL(IDBFile& idb) : _idb(idb) { }
+
+    // returns nullptr when the database has no usable type library.
+    const TILFile *get()
+    {
+        if (!_opened) {
+            _opened = true;
+            if (_idb.hassection(TILFile::INDEX)) {
+                try {
+                    _til = std::make_unique<TILFile>(_idb.getsection(TILFile::INDEX));
+                }
+                catch(const char*) {
+                }
+            }
+        }
+        return _til.get();
+    }
+    // the til entry for a member typeinfo referring to a named type.
+    std::optional<TILFile::Entry> resolve(const std::string& typeinfo)
+    {
+        if (TILFile::typedefname(typeinfo).empty() || !get())
+            return std::nullopt;
+        try {
+            return _til->resolve(typeinfo);
+        }
+        catch(const char*) {
+            return std::nullopt;
+        }
+    }
+};
+
+void jsonstructmember(const StructMember& mem, LazyTIL& til)
+{
+    ndjson->beginobject();
+    ndjson->field("name", mem.name());
+    ndjson->field("offset", mem.offset());
+    ndjson->field("size", mem.size());
+    ndjson->field("flags", mem.flags());
+    ndjson->field("props", mem.props());
+    if (uint64_t enumid = mem.enumid())
+        ndjson->field("enum", enumid);
+    if (uint64_t structid = mem.structid())
+        ndjson->field("struct", structid);
+    auto ptrinfo = mem.ptrinfo();
+    if (!ptrinfo.empty())
+        ndjson->hexfield("ptrinfo", ptrinfo);
+    auto type = mem.typeinfo();
+    if (!type.empty()) {
+        ndjson->hexfield("typeinfo", type);
+        if (auto e = til.resolve(type)) {
+            ndjson->field("typename", e->name);
+            ndjson->hexfield("tiltype", e->type);
+        }
+    }
+    ndjson->endobject();
+}
+void dumpstructmember(const StructMember& mem, LazyTIL& til)
 {
-    print("     %02x %02x %08x %02x: %-40s", 
+    output("     %02x %02x %08x %02x: %-40s", 
             mem.skip(), mem.size(), mem.flags(), mem.props(),
             mem.name());
 
     uint64_t enumid = mem.enumid();
     if (enumid)
-        print(" enum %08x", enumid);
+        output(" enum %08x", enumid);
 
     uint64_t structid = mem.structid();
     if (structid)
-        print(" struct %08x", structid);
+        output(" struct %08x", structid);
 
     auto ptrinfo = mem.ptrinfo();
     if (!ptrinfo.empty())
-        print(" ptr %b", ptrinfo);
+        output(" ptr %b", ptrinfo);
 
     auto type= mem.typeinfo();
-    if (!type.empty())
-        print(" type %b", type);
+    if (!type.empty()) {
+        output(" type %b", type);
+        if (auto e = til.resolve(type))
+            output(" (%s = %b)", e->name, e->type);
+    }
 
-    print("\n");
+    output("\n");
     return;
 }
 
 
-void dumpstruct(const Struct& s)
+void dumpstruct(const Struct& s, LazyTIL& til)
 {
-    print("struct %s,   0x%x, 0x%x\n", s.name(), s.flags(), s.seqnr());
+    if (ndjson) {
+        ndjson->beginobject();
+        ndjson->field("type", "struct");
+        ndjson->field("name", s.name());
+        ndjson->field("flags", s.flags());
+        ndjson->field("seqnr", s.seqnr());
+        ndjson->key("members");
+        ndjson->beginarray();
+        for (const auto& mem : s)
+            jsonstructmember(mem, til);
+        ndjson->endarray();
+        ndjson->endobject();
+        ndjson->newline();
+        return;
+    }
+    output("struct %s,   0x%x, 0x%x\n", s.name(), s.flags(), s.seqnr());
     for (const auto& mem : s)
-        dumpstructmember(mem);
+        dumpstructmember(mem, til);
 }
 
 /*
@@ -127,31 +265,70 @@ void dumpstruct(const Struct& s)
  */
 void dumpbfvalue(const BitfieldValue& val)
 {
-    print("   %16x %s\n", val.value(), val.name());
+    if (ndjson) {
+        ndjson->beginobject();
+        ndjson->field("value", val.value());
+        ndjson->field("name", val.name());
+        ndjson->endobject();
+        return;
+    }
+    output("   %16x %s\n", val.value(), val.name());
 }
 void dumpbfmask(const BitfieldMask& msk)
 {
-    print("    mask %x", msk.mask());
-    auto name = msk.name();
-    if (!name.empty())
-        print(" - %s", name);
-    print("\n");
+    if (ndjson) {
+        ndjson->beginobject();
+        ndjson->field("mask", msk.mask());
+        ndjson->field("name", msk.name());
+        ndjson->key("values");
+        ndjson->beginarray();
+    }
+    else {
+        output("    mask %x", msk.mask());
+        auto name = msk.name();
+        if (!name.empty())
+            output(" - %s", name);
+        output("\n");
+    }
 
     auto c = msk.first();
-    while (c.getkey() < msk.lastkey()) {
+    auto lastkey = msk.lastkey();
+    while (!c.eof() && c.getkeyref() < lastkey) {
         dumpbfvalue(msk.getvalue(c));
         c.next();
     }
+    if (ndjson) {
+        ndjson->endarray();
+        ndjson->endobject();
+    }
 }
 void dumpbitfield(ID0File & id0, uint64_t bfnode)
 {
     Bitfield e(id0, bfnode);
-    print("bitfield %s, 0x%x, 0x%x, 0x%x\n", e.name(), e.count(), e.representation(), e.flags());
+    if (ndjson) {
+        ndjson->beginobject();
+        ndjson->field("type", "bitfield");
+        ndjson->field("name", e.name());
+        ndjson->field("count", e.count());
+        ndjson->field("representation", e.representation());
+        ndjson->field("flags", e.flags());
+        ndjson->key("masks");
+        ndjson->beginarray();
+    }
+    else {
+        output("bitfield %s, 0x%x, 0x%x, 0x%x\n", e.name(), e.count(), e.representation(), e.flags());
+    }
     auto c = e.first();
-    while (c.getkey() < e.lastkey()) {
+    auto lastkey = e.lastkey();
+    while (!c.eof() && c.getkeyref() < lastkey) {
         dumpbfmask(e.getmask(c));
         c.next();
     }
+    if (ndjson) {
+        ndjson->endarray();
+        ndjson->endobject();
+        ndjson->newline();
+    }
 }
 
 /*
@@ -159,7 +336,14 @@ void dumpbitfield(ID0File & id0, uint64_t bfnode)
  */
 void dumpenummember(const EnumMember& e)
 {
-    print("    %08x %s\n", e.value(), e.name());
+    if (ndjson) {
+        ndjson->beginobject();
+        ndjson->field("value", e.value());
+        ndjson->field("name", e.name());
+        ndjson->endobject();
+        return;
+    }
+    output("    %08x %s\n", e.value(), e.name());
 }
 void dumpenum(ID0File& id0, const Enum& e)
 {
@@ -168,30 +352,49 @@ void dumpenum(ID0File& id0, const Enum& e)
         return;
     }
 
-    print("enum %s, 0x%x, 0x%x, 0x%x\n", e.name(), e.count(), e.representation(), e.flags());
+    if (ndjson) {
+        ndjson->beginobject();
+        ndjson->field("type", "enum");
+        ndjson->field("name", e.name());
+        ndjson->field("count", e.count());
+        ndjson->field("representation", e.representation());
+        ndjson->field("flags", e.flags());
+        ndjson->key("members");
+        ndjson->beginarray();
+    }
+    else {
+        output("enum %s, 0x%x, 0x%x, 0x%x\n", e.name(), e.count(), e.representation(), e.flags());
+    }
     auto c = e.first();
-    while (c.getkey() < e.lastkey()) {
+    auto lastkey = e.lastkey();
+    while (!c.eof() && c.getkeyref() < lastkey) {
         dumpenummember(e.getvalue(c));
         c.next();
     }
+    if (ndjson) {
+        ndjson->endarray();
+        ndjson->endobject();
+        ndjson->newline();
+    }
 
 }
 
 /*
  *  print list of structs / enums
  */
-void printidbstructs(ID0File& id0)
+void printidbstructs(ID0File& id0, LazyTIL& til)
 {
     auto list = List<Struct>(id0, id0.node("$ structs"));
 
-    while (!list.eof())
-        try {
-            dumpstruct(list.next());
-        }
-        catch(const char*msg)
-        {
-            print("struct entry with error found\n");
-        }
+    while (!list.eof()) {
+        auto s = Struct::tryload(id0, list.nextid());
+        if (s)
+            dumpstruct(*s, til);
+        else if (ndjson)
+            jsonerror("struct entry with error found");
+        else
+            output("struct entry with error found\n");
+    }
 }
 void printidbenums(ID0File& id0)
 {
@@ -204,12 +407,9 @@ void printidbenums(ID0File& id0)
 
 
 
-void printcomments(ID0File& id0)
-{
-// todo
-// tool which lists all comments found in the database
-
 /*
+ * print all comments found in the database
+ *
  -- nalt.hpp: NSUP_CMT = 0
  .{0X00001ddd 53 supvals 0} => "normal comment" 00
 
@@ -225,13 +425,93 @@ void printcomments(ID0File& id0)
  .{0X00001ddd 53 supvals 2000} => "posterior comment" 00
  .{0X00001ddd 53 supvals 2001} => "more" 00
  .{0X00001ddd 53 supvals 2002} => "and another posterior" 00
-*/
 
+ * all address nodes are visited in a single sequential scan,
+ * instead of looking up the comments per address.
+ */
+struct Comment {
+    uint64_t ea;
+    const char *kind;
+    int line;
+    std::string text;
+};
+
+// returns false for records which are not comments.
+bool decodecomment(const KeyView& key, std::string_view val, Comment& cmt)
+{
+    enum { NSUP_CMT = 0, NSUP_REPCMT = 1, E_PREV = 1000, E_NEXT = 2000, E_LAST = 3000 };
+
+    if (key.tag()!='S' || !key.hasindex())
+        return false;
+    uint64_t ix = key.index();
+    cmt.line = 0;
+    if (ix==NSUP_CMT)
+        cmt.kind = "regular";
+    else if (ix==NSUP_REPCMT)
+        cmt.kind = "repeatable";
+    else if (ix>=E_PREV && ix<E_NEXT) {
+        cmt.kind = "anterior";
+        cmt.line = ix-E_PREV;
+    }
+    else if (ix>=E_NEXT && ix<E_LAST) {
+        cmt.kind = "posterior";
+        cmt.line = ix-E_NEXT;
+    }
+    else
+        return false;
 
+    cmt.ea = key.nodeid();
+    cmt.text = NodeValues::getstr(val);
+    return true;
+}
+void printcomment(const Comment& cmt)
+{
+    if (ndjson) {
+        ndjson->beginobject();
+        ndjson->field("type", "comment");
+        ndjson->field("ea", cmt.ea);
+        ndjson->field("kind", cmt.kind);
+        ndjson->field("line", cmt.line);
+        ndjson->field("text", cmt.text);
+        ndjson->endobject();
+        ndjson->newline();
+    }
+    else {
+        output("%08x: %-10s %s\n", cmt.ea, cmt.kind, cmt.text);
+    }
 }
 
+// with --threads, the address range is scanned in parts, the comments
+// are collected per part, and printed in key order afterwards.
+void printcomments(ID0File& id0, const std::string& dbname)
+{
+    // the address nodes are all below the nodebase.
+    auto first = id0.makekey(0);
+    auto last = id0.makekey(id0.nodebase());
+
+    if (nthreads > 1) {
+        auto parts = id0.partition(first, last, 4*nthreads);
+        std::vector<std::vector<Comment>> found(parts.size());
+        int wordsize = id0.wordsize();
+        parallelscan(parts, id0opener(dbname), nthreads, [&found, wordsize](size_t part, BtreeBase::Cursor& c) {
+            Comment cmt;
+            if (decodecomment(KeyView(c.getkeyref(), wordsize), c.getvalref(), cmt))
+                found[part].push_back(std::move(cmt));
+            return true;
+        });
+        for (auto& part : found)
+            for (auto& cmt : part)
+                printcomment(cmt);
+        return;
+    }
 
-
+    id0.scan(first, last, [&](BtreeBase::Cursor& c) {
+        Comment cmt;
+        if (decodecomment(id0.keyview(c), c.getvalref(), cmt))
+            printcomment(cmt);
+        return true;
+    });
+}
 
 /*
  .{0X00001dd9  name} => "globallabel" 00
@@ -248,35 +528,71 @@ void printnames(ID0File& id0, ID1File& id1, NAMFile& nam, bool listall)
     nam.enumerate([&](uint64_t ea){
         uint64_t f= id1.GetFlags(ea);
         std::string name= id0.getname(ea);
-        if (listall || !(f&0x8000))
-            print("%08x: [%08x] %s\n", ea, f, name);
+        if (!listall && (f&0x8000))
+            return;
+        if (ndjson) {
+            ndjson->beginobject();
+            ndjson->field("type", "name");
+            ndjson->field("ea", ea);
+            ndjson->field("flags", f);
+            ndjson->field("name", name);
+            ndjson->endobject();
+            ndjson->newline();
+        }
+        else {
+            output("%08x: [%08x] %s\n", ea, f, name);
+        }
 
         // todo: filter out nullsub, jpt_XXX, thunks (j_...)
     });
 }
 
-// print each address in the form: <label> + offset
-void printaddrs(ID0File& id0, ID1File& id1, NAMFile& nam, const std::vector<uint64_t>& addrs)
+// print each address in the form: <label> + offset, and <function> + offset
+void printaddrs(ID0File& id0, const SegmentTable& segs, const FunctionIndex& funcs, NAMFile& nam, const std::vector<uint64_t>& addrs)
 {
-    for (uint64_t ea : addrs) {
-        auto seg0 = id1.SegStart(ea);
-        auto seg1 = id1.SegEnd(ea);
+    auto named = nam.findnames(addrs);
+    for (unsigned i=0 ; i<addrs.size() ; i++) {
+        uint64_t ea = addrs[i];
+        auto seg = segs.find(ea);
+        auto func = funcs.find(ea);
+
+        if (ndjson) {
+            ndjson->beginobject();
+            ndjson->field("type", "addr");
+            ndjson->field("ea", ea);
+            if (seg) {
+                ndjson->field("segstart", seg->start);
+                ndjson->field("segend", seg->end);
+                if (!seg->name.empty())
+                    ndjson->field("segname", seg->name);
+            }
+            if (named[i]!=BADADDR) {
+                ndjson->field("name", id0.getname(named[i]));
+                ndjson->field("nameea", named[i]);
+            }
+            if (func!=BADADDR) {
+                ndjson->field("func", id0.getname(func));
+                ndjson->field("funcea", func);
+            }
+            ndjson->endobject();
+            ndjson->newline();
+            continue;
+        }
 
         std::string segspec;
-        if (seg0!=BADADDR) {
-            if (seg0==ea)
-                segspec = stringformat("seg:%08x start", seg0);
-            else if (seg1==ea)
-                segspec = stringformat("seg:%08x end", seg0);
+        if (seg) {
+            auto segname = seg->name.empty() ? stringformat("seg:%08x", seg->start) : seg->name;
+            if (seg->start==ea)
+                segspec = stringformat("%s start", segname);
             else
-                segspec = stringformat("seg:%08x+0x%x", seg0, ea-seg0);
+                segspec = stringformat("%s+0x%x", segname, ea-seg->start);
         }
         else {
             segspec = "not in a seg";
         }
 
         std::string namespec;
-        uint64_t fea = nam.findname(ea);
+        uint64_t fea = named[i];
         if (fea == BADADDR) {
             // no names in database
             namespec = "-";
@@ -297,7 +613,112 @@ void printaddrs(ID0File& id0, ID1File& id1, NAMFile& nam, const std::vector<uint
                 namespec = stringformat("%s-0x%x", name, fea-ea);
             }
         }
-        print("%08x: %-23s %s\n", ea, segspec, namespec);
+        if (func!=BADADDR)
+            output("%08x: %-23s %-31s %s+0x%x\n", ea, segspec, namespec, id0.getname(func), ea-func);
+        else
+            output("%08x: %-23s %s\n", ea, segspec, namespec);
+    }
+}
+
+// print the segment list
+void printsegments(const SegmentTable& segs)
+{
+    for (auto& seg : segs) {
+        if (ndjson) {
+            ndjson->beginobject();
+            ndjson->field("type", "segment");
+            ndjson->field("start", seg.start);
+            ndjson->field("end", seg.end);
+            ndjson->field("name", seg.name);
+            ndjson->field("class", seg.sclass);
+            ndjson->field("perm", seg.perm);
+            ndjson->field("bitness", seg.bitness);
+            ndjson->field("align", seg.align);
+            ndjson->field("comb", seg.comb);
+            ndjson->field("segtype", seg.type);
+            ndjson->endobject();
+            ndjson->newline();
+            continue;
+        }
+        if (!segs.hasattributes()) {
+            output("seg %08x-%08x\n", seg.start, seg.end);
+            continue;
+        }
+        output("seg %08x-%08x %-12s %-8s %c%c%c %2d bit, align=%d, comb=%d, type=%d\n",
+                seg.start, seg.end, seg.name, seg.sclass,
+                (seg.perm&4) ? 'r' : '-', (seg.perm&2) ? 'w' : '-', (seg.perm&1) ? 'x' : '-',
+                16<<seg.bitness, seg.align, seg.comb, seg.type);
+    }
+}
+
+// print the type library summary, the til section is optional.
+void printtilinfo(IDBFile& idb)
+{
+    if (!idb.hassection(TILFile::INDEX))
+        return;
+    try {
+        TILFile til(idb.getsection(TILFile::INDEX));
+        if (ndjson) {
+            ndjson->beginobject();
+            ndjson->field("type", "til");
+            ndjson->field("title", til.title());
+            ndjson->field("base", til.base());
+            ndjson->field("format", til.format());
+            ndjson->field("flags", til.flags());
+            ndjson->field("symbols", til.count(TILFile::SYMBOLS));
+            ndjson->field("types", til.count(TILFile::TYPES));
+            ndjson->field("ordinals", til.nordinals());
+            ndjson->endobject();
+            ndjson->newline();
+            return;
+        }
+        output("til: %s  base=%s, format=%d, flags=%04x, %d symbols, %d types, %d ordinals\n",
+                til.title(), til.base(), til.format(), til.flags(),
+                til.count(TILFile::SYMBOLS), til.count(TILFile::TYPES), til.nordinals());
+    }
+    catch(const char*msg) {
+        if (ndjson)
+            jsonerror(std::string("til: ") + msg);
+        else
+            output("til: %s\n", msg);
+    }
+}
+
+// print the named types from the til section, only these entries are decoded.
+void printtiltypes(IDBFile& idb, const std::vector<std::string>& names)
+{
+    if (!idb.hassection(TILFile::INDEX)) {
+        if (ndjson)
+            jsonerror("til: no type library");
+        else
+            output("til: no type library\n");
+        return;
+    }
+    TILFile til(idb.getsection(TILFile::INDEX));
+    for (auto& name : names) {
+        if (!til.contains(TILFile::TYPES, name)) {
+            if (ndjson)
+                jsonerror(name + ": type not found");
+            else
+                output("%s: type not found\n", name);
+            continue;
+        }
+        auto e = til.gettype(name);
+        if (ndjson) {
+            ndjson->beginobject();
+            ndjson->field("type", "tiltype");
+            ndjson->field("name", e.name);
+            ndjson->field("ordinal", e.ordinal);
+            ndjson->field("sclass", unsigned(e.sclass));
+            ndjson->hexfield("typeinfo", e.type);
+            ndjson->hexfield("fields", e.fields);
+            ndjson->field("comment", e.comment);
+            ndjson->endobject();
+            ndjson->newline();
+            continue;
+        }
+        output("type %s: ordinal=%d, sclass=%d, type=%b, fields=%b  ; %s\n",
+                e.name, e.ordinal, e.sclass, e.type, e.fields, e.comment);
     }
 }
 
@@ -306,7 +727,17 @@ void printaddrs(ID0File& id0, ID1File& id1, NAMFile& nam, const std::vector<uint
  */
 void dumpscript(const Script& scr)
 {
-    print("======= %s %s =======\n%s\n", scr.language(), scr.name(), scr.body());
+    if (ndjson) {
+        ndjson->beginobject();
+        ndjson->field("type", "script");
+        ndjson->field("language", scr.language());
+        ndjson->field("name", scr.name());
+        ndjson->field("body", scr.body());
+        ndjson->endobject();
+        ndjson->newline();
+        return;
+    }
+    output("======= %s %s =======\n%s\n", scr.language(), scr.name(), scr.body());
 }
 
 void printidbscripts(ID0File& id0)
@@ -329,43 +760,88 @@ std::string timestring(uint32_t t)
     return stringformat("%04d-%02d-%02d %02d:%02d", tm.tm_year+1900, tm.tm_mon+1, tm.tm_mday, tm.tm_hour, tm.tm_min);
 }
 
-void dumplicense(const char *tag, const std::string& user)
+// the fields of a decoded license blob.
+struct License {
+    uint16_t version;       // 0 for licenses from before v5.3
+    uint32_t start;
+    uint32_t end;           // only for versioned licenses
+    uint32_t flags;         // only for pre v5.3 licenses
+    std::string id;         // 6 byte license id, only for versioned licenses
+    std::string licensee;
+};
+
+std::optional<License> decodelicense(const std::string& user)
 {
     if (user.size()<127)
-        return;
+        return std::nullopt;
 
     auto et = EndianTools();
 
     // if non zero data at offset 106, assume this is an invalid license blob.
     if (et.getle32(&user[106], &user[110]))
-        return;
+        return std::nullopt;
 
-    uint16_t licver= et.getle16(&user[2], &user[0]+user.size());
-    if (licver==0) {
+    License lic{};
+    lic.version= et.getle16(&user[2], &user[0]+user.size());
+    if (lic.version==0) {
         // before v5.3
         auto ts = et.getle32(&user[4], &user[8]);
         if (ts) {
-            std::string licensee= (char*)&user[20];
-            auto fl = et.getle32(&user[16], &user[20]);
-            print("%s %s [%08x]  %s\n", tag, timestring(ts), fl, licensee);
+            lic.start = ts;
+            lic.flags = et.getle32(&user[16], &user[20]);
+            lic.licensee = (char*)&user[20];
         }
         else {
-            auto ts = et.getle32(&user[0x17], &user[0x1b]);
-            auto fl = et.getle32(&user[0x23], &user[0x27]);
-            std::string licensee= (char*)&user[0x27];
-            print("%s %s [%08x]  %s\n", tag, timestring(ts), fl, licensee);
-
+            lic.start = et.getle32(&user[0x17], &user[0x1b]);
+            lic.flags = et.getle32(&user[0x23], &user[0x27]);
+            lic.licensee = (char*)&user[0x27];
         }
     }
     else {
-        std::string licensee= (char*)&user[34];
-        print("%sv%04d %s ... %s   %02x-%02x%02x-%02x%02x-%02x  %s\n",
-                tag, licver,
-                timestring(et.getle32(&user[16], &user[0]+user.size())),
-                timestring(et.getle32(&user[16+8], &user[0]+user.size())),
-                (int)(uint8_t)user[28], (int)(uint8_t)user[29], (int)(uint8_t)user[30], (int)(uint8_t)user[31], (int)(uint8_t)user[32], (int)(uint8_t)user[33],
-                licensee);
+        lic.start = et.getle32(&user[16], &user[0]+user.size());
+        lic.end = et.getle32(&user[16+8], &user[0]+user.size());
+        lic.id = user.substr(28, 6);
+        lic.licensee = (char*)&user[34];
+    }
+    return lic;
+}
+
+void dumplicense(const char *tag, const std::string& user)
+{
+    auto lic = decodelicense(user);
+    if (!lic)
+        return;
+    if (lic->version==0) {
+        output("%s %s [%08x]  %s\n", tag, timestring(lic->start), lic->flags, lic->licensee);
+    }
+    else {
+        auto& id = lic->id;
+        output("%sv%04d %s ... %s   %02x-%02x%02x-%02x%02x-%02x  %s\n",
+                tag, lic->version,
+                timestring(lic->start),
+                timestring(lic->end),
+                (int)(uint8_t)id[0], (int)(uint8_t)id[1], (int)(uint8_t)id[2], (int)(uint8_t)id[3], (int)(uint8_t)id[4], (int)(uint8_t)id[5],
+                lic->licensee);
+    }
+}
+void jsonlicense(const char *key, const std::string& user)
+{
+    auto lic = decodelicense(user);
+    if (!lic)
+        return;
+    ndjson->key(key);
+    ndjson->beginobject();
+    ndjson->field("version", unsigned(lic->version));
+    ndjson->field("start", lic->start);
+    if (lic->version==0) {
+        ndjson->field("flags", lic->flags);
+    }
+    else {
+        ndjson->field("end", lic->end);
+        ndjson->hexfield("id", lic->id);
     }
+    ndjson->field("licensee", lic->licensee);
+    ndjson->endobject();
 }
 
 /*
@@ -374,7 +850,6 @@ void dumplicense(const char *tag, const std::string& user)
 void printidbinfo(ID0File& id0)
 {
     uint64_t loadernode= id0.node("$ loader name");
-    print("loader: %s  %s\n", id0.getstr(loadernode, 'S', 0), id0.getstr(loadernode, 'S', 1));
 
     uint64_t rootnode= id0.node("Root Node");
     std::string params= id0.getdata(rootnode, 'S', 0x41b994);
@@ -382,9 +857,30 @@ void printidbinfo(ID0File& id0)
     auto nulpos = cpu.find(char(0));
     if (nulpos != cpu.npos)
         cpu.resize(nulpos);
-    print("cpu: %-8s,  idaversion=%04d: %s\n", cpu,
+    if (ndjson) {
+        ndjson->beginobject();
+        ndjson->field("type", "info");
+        ndjson->field("loader", id0.getstr(loadernode, 'S', 0));
+        ndjson->field("loaderformat", id0.getstr(loadernode, 'S', 1));
+        ndjson->field("cpu", cpu);
+        ndjson->field("idaversion", id0.getuint(rootnode, 'A', -1));
+        ndjson->field("version", id0.getstr(rootnode, 'S', 1303));
+        ndjson->field("nopens", id0.getuint(rootnode, 'A', -4));
+        ndjson->field("ctime", id0.getuint(rootnode, 'A', -2));
+        ndjson->field("crc", id0.getuint(rootnode, 'A', -5));
+        ndjson->hexfield("md5", id0.getdata(rootnode, 'S', 1302));
+#ifdef HAVE_LIBGMP
+        jsonlicense("origlicense", decryptuser(id0.getdata(id0.node("$ original user"), 'S', 0)));
+        jsonlicense("currlicense", id0.getdata(id0.node("$ user1"), 'S', 0));
+#endif
+        ndjson->endobject();
+        ndjson->newline();
+        return;
+    }
+    output("loader: %s  %s\n", id0.getstr(loadernode, 'S', 0), id0.getstr(loadernode, 'S', 1));
+    output("cpu: %-8s,  idaversion=%04d: %s\n", cpu,
             id0.getuint(rootnode, 'A', -1), id0.getstr(rootnode, 'S', 1303));
-    print("nopens=%d, ctime=%s, crc=%08x, binary md5=%b\n", 
+    output("nopens=%d, ctime=%s, crc=%08x, binary md5=%b\n", 
             id0.getuint(rootnode, 'A', -4),
             timestring(id0.getuint(rootnode, 'A', -2)),
             id0.getuint(rootnode, 'A', -5),
@@ -398,13 +894,48 @@ void printidbinfo(ID0File& id0)
 
     std::string user1= id0.getdata(id0.node("$ user1"), 'S', 0);
     if (verbose)
-        print("\n%b\n%b\n", user0, user1);
+        output("\n%b\n%b\n", user0, user1);
 
     dumplicense("orig: ", user0);
     dumplicense("curr: ", user1);
 #endif
 }
 
+// print the record at the cursor position,
+// batch queries pass the query id.
+void printrecord(const BtreeBase::Cursor& c, int queryid = -1)
+{
+    if (ndjson) {
+        ndjson->beginobject();
+        ndjson->field("type", "record");
+        if (queryid>=0)
+            ndjson->field("query", queryid);
+        ndjson->hexfield("key", c.getkeyref());
+        ndjson->hexfield("value", c.getvalref());
+        ndjson->endobject();
+        ndjson->newline();
+        return;
+    }
+    if (queryid>=0)
+        output("%d: ", queryid);
+    // the formatter's %b takes a std::string, so only the text form copies.
+    output("%-b = %-b\n", c.getkey(), c.getval());
+}
+
+void printqueryerror(int queryid, const char *msg)
+{
+    if (ndjson) {
+        ndjson->beginobject();
+        ndjson->field("type", "error");
+        ndjson->field("query", queryid);
+        ndjson->field("message", msg);
+        ndjson->endobject();
+        ndjson->newline();
+        return;
+    }
+    output("%d: ERROR: %s\n", queryid, msg);
+}
+
 /*
  * print all nodes in sequential order
  */
@@ -414,7 +945,7 @@ void dumpnodes(ID0File& id0, bool ascending, int limit)
                        : id0.find(REL_LESS_EQUAL, "\xFF\xFF\xFF\xFF");
     while (!c.eof() && limit!=0)
     {
-        print("%-b = %-b\n", c.getkey(), c.getval());
+        printrecord(c);
         if (ascending)
             c.next();
         else
@@ -425,6 +956,131 @@ void dumpnodes(ID0File& id0, bool ascending, int limit)
     }
 }
 
+/*
+ * export all records, with the decoded key fields, in the columnar format
+ * described in columnwriter.h, using a single sequential scan.
+ *
+ * columns: key, value, kind, nodeid, tag, hasindex, index
+ * the decoded fields are only set for '.' node keys:
+ *   .<nodeid:word>                   -> tag = 0
+ *   .<nodeid:word><tag>              -> hasindex = 0
+ *   .<nodeid:word><tag><index:word>  -> hasindex = 1
+ *   .<nodeid:word><tag><hashkey>     -> hasindex = 0, the hashkey is only in the key column.
+ */
+void exportcolumns(ID0File& id0, const std::string& dbname, const std::string& exportname)
+{
+    std::ofstream os(exportname, std::ios::binary | std::ios::trunc);
+    if (!os)
+        throw "can't create export file";
+    ColumnWriter cw(os, stringformat("source=%s\nwordsize=%d\n", dbname, id0.wordsize()));
+    int colkey = cw.addcolumn("key", ColumnWriter::BINARY);
+    int colvalue = cw.addcolumn("value", ColumnWriter::BINARY);
+    int colkind = cw.addcolumn("kind", ColumnWriter::U8);
+    int colnodeid = cw.addcolumn("nodeid", ColumnWriter::U64);
+    int coltag = cw.addcolumn("tag", ColumnWriter::U8);
+    int colhasindex = cw.addcolumn("hasindex", ColumnWriter::U8);
+    int colindex = cw.addcolumn("index", ColumnWriter::U64);
+
+    auto c = id0.find(REL_GREATER_EQUAL, "");
+    while (!c.eof())
+    {
+        auto key = id0.keyview(c);
+
+        cw.set(colkey, key.data());
+        cw.set(colvalue, c.getvalref());
+        cw.set(colkind, uint8_t(key.kind()));
+        cw.set(colnodeid, key.nodeid());
+        cw.set(coltag, uint8_t(key.tag()));
+        cw.set(colhasindex, key.hasindex());
+        cw.set(colindex, key.index());
+        cw.endrow();
+
+        c.next();
+    }
+    uint64_t nrows = cw.finish();
+    if (!os)
+        throw "error writing export file";
+    if (verbose && ndjson) {
+        ndjson->beginobject();
+        ndjson->field("type", "export");
+        ndjson->field("file", exportname);
+        ndjson->field("records", nrows);
+        ndjson->endobject();
+        ndjson->newline();
+    }
+    else if (verbose) {
+        output("exported %d records to %s\n", nrows, exportname);
+    }
+}
+
+/*
+ * write the xref graph as a binary file, all integers are little endian:
+ *
+ *    char[8]               "IDBXREF1"
+ *    uint32                wordsize
+ *    uint64                nsources
+ *    uint64                nedges
+ *    word[nsources]        sources, ascending
+ *    uint64[nsources+1]    offsets: the edges of sources[i] are [offsets[i], offsets[i+1])
+ *    word[nedges]          targets
+ *    uint8[nedges]         kinds: 'x' = code, 'd' = data
+ *    uint8[nedges]         reftypes
+ *
+ * a word is `wordsize` bytes.
+ */
+void exportxrefs(ID0File& id0, const std::string& dbname, const std::string& xrefname)
+{
+    auto g = nthreads > 1 ? XrefGraph::load(id0, id0opener(dbname), nthreads) : XrefGraph::load(id0);
+
+    std::ofstream os(xrefname, std::ios::binary | std::ios::trunc);
+    if (!os)
+        throw "can't create xref file";
+    int wordsize = id0.wordsize();
+    std::string buf;
+    auto put = [&buf](uint64_t v, int n) {
+        for (int i=0 ; i<n ; i++) {
+            buf += char(v);
+            v >>= 8;
+        }
+    };
+    auto flush = [&buf, &os]() {
+        os.write(buf.data(), buf.size());
+        buf.clear();
+    };
+    auto putarray = [&](const auto& v, int n) {
+        for (auto x : v) {
+            put(x, n);
+            if (buf.size() >= 0x10000)
+                flush();
+        }
+        flush();
+    };
+
+    buf = "IDBXREF1";
+    put(wordsize, 4);
+    put(g.sources.size(), 8);
+    put(g.nedges(), 8);
+    putarray(g.sources, wordsize);
+    putarray(g.offsets, 8);
+    putarray(g.targets, wordsize);
+    putarray(g.kinds, 1);
+    putarray(g.reftypes, 1);
+    if (!os)
+        throw "error writing xref file";
+    if (verbose && ndjson) {
+        ndjson->beginobject();
+        ndjson->field("type", "xrefs");
+        ndjson->field("file", xrefname);
+        ndjson->field("edges", uint64_t(g.nedges()));
+        ndjson->field("sources", uint64_t(g.sources.size()));
+        ndjson->endobject();
+        ndjson->newline();
+    }
+    else if (verbose) {
+        output("exported %d xrefs from %d addresses to %s\n", g.nedges(), g.sources.size(), xrefname);
+    }
+}
+
 /*
  * perform simple queries on the .idb database
  */
@@ -488,11 +1144,62 @@ std::string createkey(ID0File& id0, const char *key, const char *keyend)
     return id0.makekey(nodeid, tag, ix);
 }
 
-// parse and execute the query.
-void queryidb(ID0File& id0, const std::string& query, bool ascending, int limit)
+// parses a range query into a [lo, hi) key range.
+// returns false when the key is not a range.
+//
+//   <keyspec>;*          -> all records starting with the keyspec
+//   <keyspec>;a..b       -> the last item of the keyspec in the range [a, b)
+//   *                    -> the entire database
+bool createrange(ID0File& id0, const char *key, const char *keyend, std::string& lo, std::string& hi)
 {
-    if (query.size()<=2)
-        return;
+    if (keyend-key==1 && *key=='*') {
+        lo.clear();
+        hi.clear();
+        return true;
+    }
+    if (keyend-key>=2 && keyend[-1]=='*' && keyend[-2]==';') {
+        lo = createkey(id0, key, keyend-2);
+        hi = ID0File::prefixend(lo);
+        return true;
+    }
+    if (keyend-key < 1)
+        return false;
+    // search for '..' after a possible '.' node prefix
+    const char *dots = "..";
+    auto r = std::search(key+1, keyend, dots, dots+2);
+    if (r==keyend)
+        return false;
+
+    // the start of the item containing the range
+    auto item = r;
+    while (item>key && item[-1]!=';')
+        item--;
+    if (item==key && (*key=='.' || *key=='#' || *key=='?'))
+        item++;
+
+    std::string hikey = std::string(key, item) + std::string(r+2, keyend);
+    lo = createkey(id0, key, r);
+    hi = createkey(id0, hikey.c_str(), hikey.c_str()+hikey.size());
+    return true;
+}
+
+// a parsed query, see parsequery.
+struct Query {
+    int id = -1;            // the line number for batch queries
+    bool isrange = false;
+    relation_t rel = REL_EQUAL;
+    std::string key;        // for relation queries
+    std::string lo, hi;     // for range queries: [lo, hi)
+
+    // the first key visited by the query, used to sort batch queries.
+    const std::string& startkey() const { return isrange ? lo : key; }
+};
+
+// parse the query into a relation + key, or a key range.
+Query parsequery(ID0File& id0, const std::string& query)
+{
+    if (query.empty())
+        throw "empty query";
     int flags = 0;
     const char *key = nullptr;
     switch(query[0])
@@ -510,14 +1217,54 @@ void queryidb(ID0File& id0, const std::string& query, bool ascending, int limit)
         default: if (!key) key = &query[1];
     }
     if (!key) key = &query[2];
+    const char *keyend = &query[0]+query.size();
+    // a relation without a key: "=", "<", ">=", ...
+    if (key >= keyend)
+        throw "empty key";
+
+    Query q;
+    if (createrange(id0, key, keyend, q.lo, q.hi)) {
+        if (flags)
+            throw "range queries can't be combined with a relation";
+        q.isrange = true;
+        return q;
+    }
+
     if (flags==0) flags = FL_EQ;
+    q.rel = xlat_relation(flags);
+    q.key = createkey(id0, key, keyend);
+    return q;
+}
+
+// execute the query, printing at most `limit` records.
+void runquery(ID0File& id0, const Query& q, bool ascending, int limit)
+{
+    if (q.isrange) {
+        if (verbose && !ndjson) {
+            auto est = id0.estimate(q.lo, q.hi);
+            output("range: about %d records in %d leaf pages\n", est.records, est.pages);
+        }
+        auto cb = [&limit, &q](BtreeBase::Cursor& c) {
+            if (limit==0)
+                return false;
+            printrecord(c, q.id);
+            if (limit>0)
+                limit--;
+            return true;
+        };
+        if (ascending)
+            id0.scan(q.lo, q.hi, cb);
+        else
+            id0.rscan(q.lo, q.hi, cb);
+        return;
+    }
 
-    auto c = id0.find(xlat_relation(flags), createkey(id0, key, &query[0]+query.size()));
+    auto c = id0.find(q.rel, q.key);
 
     while (!c.eof() && limit!=0)
     {
-        print("%-b = %-b\n", c.getkey(), c.getval());
-        if (flags == FL_EQ)
+        printrecord(c, q.id);
+        if (q.rel == REL_EQUAL)
             break;
         if (ascending)
             c.next();
@@ -528,10 +1275,54 @@ void queryidb(ID0File& id0, const std::string& query, bool ascending, int limit)
     }
 }
 
+// parse and execute the query.
+void queryidb(ID0File& id0, const std::string& query, bool ascending, int limit)
+{
+    if (query.empty())
+        return;
+    runquery(id0, parsequery(id0, query), ascending, limit);
+}
+
+// execute a list of queries, the output is tagged with the query line number.
+//
+// the queries are executed in key order, with a page cache,
+// so queries for nearby keys share their page reads.
+enum { QUERY_CACHE_PAGES = 4096 };
+void querybatch(ID0File& id0, const std::vector<std::string>& queries, bool ascending, int limit)
+{
+    std::vector<Query> parsed;
+    parsed.reserve(queries.size());
+    for (unsigned i=0 ; i<queries.size() ; i++) {
+        if (queries[i].empty())
+            continue;
+        try {
+            parsed.push_back(parsequery(id0, queries[i]));
+            parsed.back().id = i+1;
+        }
+        catch(const char*msg) {
+            printqueryerror(i+1, msg);
+        }
+    }
+    std::stable_sort(parsed.begin(), parsed.end(), [](const Query& a, const Query& b) {
+        return a.startkey() < b.startkey();
+    });
+
+    id0.setcachesize(QUERY_CACHE_PAGES);
+    for (auto& q : parsed) {
+        try {
+            runquery(id0, q, ascending, limit);
+        }
+        catch(const char*msg) {
+            printqueryerror(q.id, msg);
+        }
+    }
+    id0.setcachesize(0);
+}
+
 void usage()
 {
     printf("idbtool OPTIONS  <files> [-- ADDRLIST]\n");
-    printf("    -s | --scripts    print all scripts\n"); //  -c | --comments   print all comments
+    printf("    -s | --scripts    print all scripts          -c | --comments   print all comments\n");
     printf("    -t | --structs    print all structs          -i | --info       print database info\n");
     printf("    -e | --enums      print all enums            -d | --id0        low level db dump\n");
     printf("    -n | --names      print generated names      -inc | --inc      dump all records in ascending order\n");
@@ -539,12 +1330,27 @@ void usage()
     printf("when the ADDRLIST is specified, the addresses in the list are printed as 'name+offset'\n");
 
     printf("    -q | --query  QUERY                          -m LIMIT          number of records printed\n");
+    printf("    --query-file FILE run all queries from FILE, one per line, '-' reads stdin.\n");
+    printf("                      results are prefixed with the query line number.\n");
+    printf("    --stats           print the idblib counters, needs a build with IDB_WITH_STATS\n");
+    printf("    --trace FILE      write chrome trace-event json with the time spent per database and phase\n");
+    printf("    --format=ndjson   output one json object per line, with a 'type' field:\n");
+    printf("                      database, info, segment, til, tiltype, script, comment, struct, enum, bitfield, name, addr, record, stats, error\n");
+    printf("    --export FILE     export all id0 records with decoded keys to a columnar binary file\n");
+    printf("    --xrefs FILE      export the code and data xref graph to a binary file\n");
+    printf("    --threads N       number of threads used by --xrefs and --comments, default 1\n");
+    printf("    --type NAME       print a type from the type library, can be repeated\n");
+    printf("    --serve SOCKET    keep the databases open, and answer requests on a unix domain socket\n");
     printf("example queries:\n");
     printf("  * '?Root Node' -> prints the Name node pointing to the root\n");
     printf("  * '>Root Node' -> prints the first 10 records after the root node\n");
     printf("  * '<Root Node' -> prints the 10 records startng with the recordsbefore the rootnode.\n");
     printf("  * '.0xff000001;N' -> prints rootnode name entry.\n");
     printf("  * '#1;N' -> prints rootnode name entry.\n");
+    printf("range queries print all records in the range [lo, hi):\n");
+    printf("  * 'Root Node;*' -> prints all records of the root node.\n");
+    printf("  * '.0xff000001;S;0x1000..0x2000' -> prints the 'S' records with index 0x1000 upto 0x2000.\n");
+    printf("  * '*' -> prints the entire database.\n");
 
 }
 
@@ -559,42 +1365,447 @@ void usage()
 #define DUMP_DESCENDING 256
 #define DUMP_DATABASE   512
 #define QUERY_IDB      1024
+#define PRINT_STATS    2048
+#define QUERY_BATCH    4096
+
+// print the idblib counters, collected while processing a database.
+void printstats()
+{
+#ifdef IDB_WITH_STATS
+    if (ndjson) {
+        ndjson->beginobject();
+        ndjson->field("type", "stats");
+        idbstats().foreach([](const char *name, IdbStats::counter_t& value) {
+            ndjson->field(name, uint64_t(value.load()));
+        });
+        ndjson->endobject();
+        ndjson->newline();
+        return;
+    }
+    print("-- stats\n");
+    idbstats().foreach([](const char *name, IdbStats::counter_t& value) {
+        print("%-24s %12d\n", name, value.load());
+    });
+#else
+    if (ndjson)
+        jsonerror("idbtool was built without IDB_WITH_STATS");
+    else
+        print("idbtool was built without IDB_WITH_STATS\n");
+#endif
+}
+
+// writes chrome trace-event json, enabled with --trace.
+//
+// Each database and each phase of processidb is a 'complete' event,
+// with a build using IDB_WITH_STATS, page reads are added as well.
+// Events can be added from any thread, the threads are numbered from 1
+// in the order in which they first add an event.
+class TraceLog {
+    std::ofstream _os;
+    JsonWriter _json;
+    std::chrono::steady_clock::time_point _start;
+    std::mutex _lock;
+    int _nthreads = 0;
+
+    int threadnumber()
+    {
+        thread_local int nr = 0;
+        if (nr==0)
+            nr = ++_nthreads;
+        return nr;
+    }
+public:
+    typedef std::chrono::steady_clock::time_point time_point;
+
+    TraceLog(const std::string& fn)
+        : _os(fn), _json(_os), _start(std::chrono::steady_clock::now())
+    {
+        if (!_os)
+            throw "can't create trace file";
+        _json.beginobject();
+        _json.key("traceEvents");
+        _json.beginarray();
+    }
+    ~TraceLog()
+    {
+        _json.endarray();
+        _json.endobject();
+        _json.newline();
+    }
+    double microseconds(time_point t) const
+    {
+        return std::chrono::duration<double, std::micro>(t - _start).count();
+    }
+
+    void complete(const std::string& name, const char *category, time_point t0, time_point t1)
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _json.beginobject();
+        _json.field("name", name);
+        _json.field("cat", category);
+        _json.field("ph", "X");
+        _json.field("ts", microseconds(t0));
+        _json.field("dur", microseconds(t1) - microseconds(t0));
+        _json.field("pid", 1);
+        _json.field("tid", threadnumber());
+        _json.endobject();
+    }
+};
+std::unique_ptr<TraceLog> tracelog;
+
+// a trace span, for the lifetime of this object.
+class TraceSpan {
+    std::string _name;
+    const char *_category;
+    TraceLog::time_point _t0;
+public:
+    TraceSpan(const std::string& name, const char *category = "phase")
+        : _name(name), _category(category)
+    {
+        if (tracelog)
+            _t0 = std::chrono::steady_clock::now();
+    }
+    ~TraceSpan()
+    {
+        if (tracelog)
+            tracelog->complete(_name, _category, _t0, std::chrono::steady_clock::now());
+    }
+};
+
+#ifdef IDB_WITH_STATS
+void tracepageread(uint32_t nr, TraceLog::time_point t0, TraceLog::time_point t1)
+{
+    tracelog->complete(stringformat("page %d", nr), "pageread", t0, t1);
+}
+#endif
 
 // perform the options specified on the commandline on a specific idb file.
-void processidb(const std::string& fn, int flags, const std::string& query, const std::vector<uint64_t>& addrs, int limit)
+void processidb(const std::string& fn, int flags, const std::string& query, const std::vector<std::string>& batch, const std::vector<uint64_t>& addrs, int limit, const std::string& exportname, const std::string& xrefname, const std::vector<std::string>& tiltypes)
 {
+    TraceSpan dbspan(fn, "database");
+
+    auto openspan = std::make_unique<TraceSpan>("open");
     IDBFile idb(std::make_shared<std::ifstream>(fn));
     ID0File id0(idb, idb.getsection(ID0File::INDEX));
     ID1File id1(idb, idb.getsection(ID1File::INDEX));
     NAMFile nam(idb, idb.getsection(NAMFile::INDEX));
+    openspan.reset();
+
+    // runs `fn` as a separate trace phase.
+    auto phase = [](const char *name, auto fn) {
+        TraceSpan span(name);
+        fn();
+    };
 
     if (flags&PRINT_INFO)
-        printidbinfo(id0);
+        phase("info", [&]() {
+            printidbinfo(id0);
+            printsegments(SegmentTable(id0, id1));
+            printtilinfo(idb);
+        });
     if (flags&PRINT_SCRIPTS)
-        printidbscripts(id0);
+        phase("scripts", [&]() { printidbscripts(id0); });
     if (flags&PRINT_COMMENTS)
-        printcomments(id0);
+        phase("comments", [&]() { printcomments(id0, fn); });
     if (flags&PRINT_STRUCTS)
-        printidbstructs(id0);
+        phase("structs", [&]() {
+            LazyTIL til(idb);
+            printidbstructs(id0, til);
+        });
     if (flags&PRINT_ENUMS)
-        printidbenums(id0);
+        phase("enums", [&]() { printidbenums(id0); });
     if (flags&PRINT_NAMES)
-        printnames(id0, id1, nam, flags&LISTALL_NAMES);
+        phase("names", [&]() { printnames(id0, id1, nam, flags&LISTALL_NAMES); });
+
+    if (!tiltypes.empty())
+        phase("types", [&]() { printtiltypes(idb, tiltypes); });
 
     if (!addrs.empty())
-        printaddrs(id0, id1, nam, addrs);
+        phase("addrs", [&]() { printaddrs(id0, SegmentTable(id0, id1), FunctionIndex(id0), nam, addrs); });
 
-    if (flags&QUERY_IDB)
-        queryidb(id0, query, !(flags&DUMP_DESCENDING), limit);
+    if (flags&QUERY_BATCH)
+        phase("query", [&]() { querybatch(id0, batch, !(flags&DUMP_DESCENDING), limit); });
+    else if (flags&QUERY_IDB)
+        phase("query", [&]() { queryidb(id0, query, !(flags&DUMP_DESCENDING), limit); });
     else if (flags&(DUMP_ASCENDING|DUMP_DESCENDING))
-        dumpnodes(id0, flags&DUMP_ASCENDING, limit);
+        phase("dump", [&]() { dumpnodes(id0, flags&DUMP_ASCENDING, limit); });
+
+    if (!exportname.empty())
+        phase("export", [&]() { exportcolumns(id0, fn, exportname); });
+    if (!xrefname.empty())
+        phase("xrefs", [&]() { exportxrefs(id0, fn, xrefname); });
 
     if (flags&DUMP_DATABASE) {
-        id1.dump_info();
-        id0.dump();
+        phase("id0", [&]() {
+            // the page dump is printed directly, it has no ndjson form.
+            if (ndjson) {
+                jsonerror("--id0 is not supported with --format=ndjson");
+                return;
+            }
+            id1.dump_info();
+            id0.dump();
+        });
     }
 }
 
+#ifndef _WIN32
+/*
+ * serve mode: keeps the databases open, and answers requests on a unix domain socket.
+ *
+ * request:   uint32 size, followed by the request text:  "<dbindex> <command> <argument>"
+ * response:  uint32 size, uint8 status: 0 = ok, 1 = error, followed by the output,
+ *            or the error message.
+ * sizes are little endian, the response size includes the status byte.
+ *
+ * commands:
+ *    list                 -> the open databases, one per line: "<dbindex> <filename>"
+ *    <db> name NAME       -> the address for NAME
+ *    <db> addr EA         -> EA as name+offset, like the ADDRLIST output
+ *    <db> query QUERY     -> the records matching QUERY, see --query
+ *    <db> struct NAME     -> the struct definition
+ *    <db> enum NAME       -> the enum definition
+ *
+ * each client is handled by its own thread, requests for the same database are serialized.
+ */
+enum { SERVE_CACHE_PAGES = 4096, SERVE_MAXREQUEST = 0x10000 };
+
+struct ServedDatabase {
+    std::string filename;
+    IDBFile idb;
+    ID0File id0;
+    ID1File id1;
+    NAMFile nam;
+    SegmentTable segs;
+    FunctionIndex funcs;
+    LazyTIL til;
+    std::mutex lock;
+
+    ServedDatabase(const std::string& fn)
+        : filename(fn), idb(std::make_shared<std::ifstream>(fn)),
+          id0(idb, idb.getsection(ID0File::INDEX)),
+          id1(idb, idb.getsection(ID1File::INDEX)),
+          nam(idb, idb.getsection(NAMFile::INDEX)),
+          segs(id0, id1),
+          funcs(id0),
+          til(idb)
+    {
+        id0.setcachesize(SERVE_CACHE_PAGES);
+    }
+};
+typedef std::vector<std::unique_ptr<ServedDatabase>> databaselist_t;
+
+// redirects the output of this thread to a string.
+class OutputCapture {
+    std::ostringstream _os;
+    std::unique_ptr<JsonWriter> _json;
+    std::string& _out;
+public:
+    OutputCapture(std::string& out, bool json)
+        : _out(out)
+    {
+        if (json) {
+            _json = std::make_unique<JsonWriter>(_os);
+            ndjson = _json.get();
+        }
+        else {
+            outbuf = &_out;
+        }
+    }
+    ~OutputCapture()
+    {
+        if (_json) {
+            _json->flush();
+            _out = _os.str();
+        }
+        ndjson = nullptr;
+        outbuf = nullptr;
+    }
+};
+
+// executes one request, and returns the output.
+std::string serverequest(databaselist_t& dbs, const std::string& request, bool json, int limit)
+{
+    std::string out;
+    if (request == "list") {
+        for (unsigned i=0 ; i<dbs.size() ; i++)
+            out += stringformat("%d %s\n", i, dbs[i]->filename);
+        return out;
+    }
+    auto p = request.c_str();
+    auto end = p + request.size();
+    auto r = parseunsigned(p, end, 0);
+    if (r.second==p || r.first >= dbs.size())
+        throw "invalid database index";
+    p = r.second;
+    while (p<end && *p==' ') p++;
+    auto cmdend = std::find(p, end, ' ');
+    std::string cmd(p, cmdend);
+    std::string arg(cmdend<end ? cmdend+1 : end, end);
+
+    auto& db = *dbs[r.first];
+    std::lock_guard<std::mutex> lock(db.lock);
+    {
+        OutputCapture capture(out, json);
+        if (cmd == "name") {
+            uint64_t ea = db.id0.node(arg);
+            if (!ea)
+                throw "name not found";
+            if (ndjson) {
+                ndjson->beginobject();
+                ndjson->field("type", "name");
+                ndjson->field("ea", ea);
+                ndjson->field("name", arg);
+                ndjson->endobject();
+                ndjson->newline();
+            }
+            else {
+                output("%08x\n", ea);
+            }
+        }
+        else if (cmd == "addr") {
+            auto a = parseunsigned(arg.c_str(), arg.c_str()+arg.size(), 0);
+            if (arg.empty() || a.second != arg.c_str()+arg.size())
+                throw "invalid address";
+            printaddrs(db.id0, db.segs, db.funcs, db.nam, { a.first });
+        }
+        else if (cmd == "query") {
+            queryidb(db.id0, arg, true, limit);
+        }
+        else if (cmd == "struct") {
+            uint64_t node = db.id0.node(arg);
+            if (!node)
+                throw "struct not found";
+            dumpstruct(Struct(db.id0, node), db.til);
+        }
+        else if (cmd == "enum") {
+            uint64_t node = db.id0.node(arg);
+            if (!node)
+                throw "enum not found";
+            dumpenum(db.id0, Enum(db.id0, node));
+        }
+        else {
+            throw "unknown command";
+        }
+    }
+    return out;
+}
+
+bool readall(int fd, char *p, size_t n)
+{
+    while (n) {
+        auto r = read(fd, p, n);
+        if (r<0 && errno==EINTR)
+            continue;
+        if (r<=0)
+            return false;
+        p += r;
+        n -= r;
+    }
+    return true;
+}
+bool writeall(int fd, const char *p, size_t n)
+{
+    while (n) {
+        auto r = write(fd, p, n);
+        if (r<0 && errno==EINTR)
+            continue;
+        if (r<=0)
+            return false;
+        p += r;
+        n -= r;
+    }
+    return true;
+}
+
+// handles requests from one client, until it disconnects.
+// the client threads are detached, and share ownership of the database list,
+// so it stays valid when the server stops while clients are still connected.
+void serveclient(int fd, std::shared_ptr<databaselist_t> dbs, bool json, int limit)
+{
+    while (true) {
+        char hdr[4];
+        if (!readall(fd, hdr, 4))
+            break;
+        uint32_t size = EndianTools::getle32(hdr, hdr+4);
+        if (size > SERVE_MAXREQUEST)
+            break;
+        std::string request(size, char(0));
+        if (size && !readall(fd, &request[0], size))
+            break;
+
+        std::string response(5, char(0));
+        try {
+            response += serverequest(*dbs, request, json, limit);
+        }
+        catch(const std::exception & e) {
+            response.resize(5);
+            response[4] = 1;
+            response += e.what();
+        }
+        catch(const char * msg) {
+            response.resize(5);
+            response[4] = 1;
+            response += msg;
+        }
+        EndianTools::setle32(response.begin(), response.end(), response.size()-4);
+        if (!writeall(fd, response.data(), response.size()))
+            break;
+    }
+    close(fd);
+}
+
+int servedatabases(const std::string& socketpath, const std::vector<std::string>& idbnames, bool json, int limit)
+{
+    auto dbs = std::make_shared<databaselist_t>();
+    for (auto& fn : idbnames)
+        dbs->push_back(std::make_unique<ServedDatabase>(fn));
+
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (socketpath.size() >= sizeof(addr.sun_path))
+        throw "socket path too long";
+    std::copy(socketpath.begin(), socketpath.end(), addr.sun_path);
+
+    int s = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (s < 0)
+        throw "can't create socket";
+    // only replace a stale socket, never some other file at a mistyped path.
+    struct stat st;
+    if (lstat(socketpath.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            close(s);
+            throw "serve path exists, and is not a socket";
+        }
+        unlink(socketpath.c_str());
+    }
+    if (bind(s, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(s, 16) < 0) {
+        close(s);
+        throw "can't listen on socket";
+    }
+    // a client closing its connection should not terminate the server.
+    signal(SIGPIPE, SIG_IGN);
+
+    if (verbose && !json)
+        print("serving %d databases on %s\n", dbs->size(), socketpath);
+    while (true) {
+        int c = accept(s, nullptr, nullptr);
+        if (c < 0) {
+            if (errno==EINTR)
+                continue;
+            break;
+        }
+        std::thread(serveclient, c, dbs, json, limit).detach();
+    }
+    close(s);
+    throw "accept failed";
+}
+#else
+int servedatabases(const std::string& socketpath, const std::vector<std::string>& idbnames, bool json, int limit)
+{
+    throw "serve mode is not supported on windows";
+}
+#endif
+
 
 int main(int argc, char**argv)
 {
@@ -602,7 +1813,14 @@ int main(int argc, char**argv)
     std::vector<std::string> idbnames;
     std::vector<uint64_t> addrs;
     std::string query;
+    std::string queryfile;
     int limit = -1;
+    std::string tracefile;
+    std::string format = "text";
+    std::string exportname;
+    std::string servesocket;
+    std::string xrefname;
+    std::vector<std::string> tiltypes;
 
     int flags= 0;
 
@@ -615,14 +1833,26 @@ int main(int argc, char**argv)
                       else if (arg.match("--scripts")) flags |= PRINT_SCRIPTS;
                       else if (arg.match("--structs")) flags |= PRINT_STRUCTS;
                       else if (arg.match("--enums"))   flags |= PRINT_ENUMS;
-                      //else if (arg.match("--comments"))flags |= PRINT_COMMENTS;
+                      else if (arg.match("--comments"))flags |= PRINT_COMMENTS;
                       else if (arg.match("--id0"))     flags |= DUMP_DATABASE;
                       else if (arg.match("--info"))    flags |= PRINT_INFO;
                       else if (arg.match("--limit"))   limit = arg.getint();
+                      else if (arg.match("--query-file")) {
+                          flags |= QUERY_BATCH;
+                          queryfile = arg.getstr();
+                      }
                       else if (arg.match("--query")) {
                           flags |= QUERY_IDB;
                           query = arg.getstr();
                       }
+                      else if (arg.match("--stats"))   flags |= PRINT_STATS;
+                      else if (arg.match("--trace"))   tracefile = arg.getstr();
+                      else if (arg.match("--format"))  format = arg.getstr();
+                      else if (arg.match("--export"))  exportname = arg.getstr();
+                      else if (arg.match("--serve"))   servesocket = arg.getstr();
+                      else if (arg.match("--xrefs"))   xrefname = arg.getstr();
+                      else if (arg.match("--type"))    tiltypes.push_back(arg.getstr());
+                      else if (arg.match("--threads")) nthreads = arg.getint();
                       else if (arg.match("--inc")) flags |= DUMP_ASCENDING;
                       else if (arg.match("--dec")) flags |= DUMP_DESCENDING;
                       else if (arg.optionterminator()) {
@@ -634,7 +1864,7 @@ int main(int argc, char**argv)
             case 'n': flags |= PRINT_NAMES; break;
             case 's': flags |= PRINT_SCRIPTS; break;
             case 'u': flags |= PRINT_STRUCTS; break;
-            //case 'c': flags |= PRINT_COMMENTS; break;
+            case 'c': flags |= PRINT_COMMENTS; break;
             case 'e': flags |= PRINT_ENUMS; break;
             case 'd': if (arg.match("-dec"))
                           flags |= DUMP_DESCENDING;
@@ -667,23 +1897,102 @@ int main(int argc, char**argv)
         usage();
         return 1;
     }
+    if ((!exportname.empty() || !xrefname.empty()) && idbnames.size()>1) {
+        print("--export and --xrefs can be used with only one database\n");
+        return 1;
+    }
+    // read the batch queries once, since stdin can't be read again for the next database.
+    std::vector<std::string> batch;
+    if (flags&QUERY_BATCH) {
+        std::ifstream qf;
+        if (queryfile != "-") {
+            qf.open(queryfile);
+            if (!qf) {
+                print("can't open %s\n", queryfile);
+                return 1;
+            }
+        }
+        std::istream& is = queryfile=="-" ? std::cin : qf;
+        std::string line;
+        while (std::getline(is, line)) {
+            if (!line.empty() && line.back()=='\r')
+                line.pop_back();
+            batch.push_back(line);
+        }
+    }
+    std::unique_ptr<JsonWriter> jsonwriter;
+    if (format == "ndjson") {
+        jsonwriter = std::make_unique<JsonWriter>(std::cout);
+        ndjson = jsonwriter.get();
+    }
+    else if (format != "text") {
+        usage();
+        return 1;
+    }
+    if (!servesocket.empty()) {
+        try {
+            return servedatabases(servesocket, idbnames, format=="ndjson", limit);
+        }
+        catch(const std::exception & e) {
+            if (ndjson)
+                jsonerror(e.what());
+            else
+                print("EXCEPTION: %s\n", e.what());
+        }
+        catch(const char * msg) {
+            if (ndjson)
+                jsonerror(msg);
+            else
+                print("ERROR: %s\n", msg);
+        }
+        return 1;
+    }
+    if (!tracefile.empty()) {
+        tracelog = std::make_unique<TraceLog>(tracefile);
+#ifdef IDB_WITH_STATS
+        idbstats().pagereadhook = tracepageread;
+#endif
+    }
 
     for (auto const&arg : idbnames)
     {
-        if (idbnames.size()>1)
+        if (ndjson) {
+            ndjson->beginobject();
+            ndjson->field("type", "database");
+            ndjson->field("file", arg);
+            ndjson->endobject();
+            ndjson->newline();
+        }
+        else if (idbnames.size()>1) {
             print("==> %s <==\n", arg);
+        }
+#ifdef IDB_WITH_STATS
+        idbstats().reset();
+#endif
         try {
-        processidb(arg, flags, query, addrs, limit);
+        processidb(arg, flags, query, batch, addrs, limit, exportname, xrefname, tiltypes);
         }
         catch(const std::exception & e) {
-            print("EXCEPTION: %s\n", e.what());
+            if (ndjson)
+                jsonerror(e.what());
+            else
+                print("EXCEPTION: %s\n", e.what());
         }
         catch(const char * msg) {
-            print("ERROR: %s\n", msg);
+            if (ndjson)
+                jsonerror(msg);
+            else
+                print("ERROR: %s\n", msg);
         }
-        if (idbnames.size()>1)
+        if (flags&PRINT_STATS)
+            printstats();
+        if (ndjson)
+            ndjson->flush();
+        else if (idbnames.size()>1)
             print("\n");
     }
+    // finish the trace json
+    tracelog.reset();
 
     return 0;
 }
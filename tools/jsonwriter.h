@@ -0,0 +1,215 @@
+/*
+ * jsonwriter.h: a streaming json writer for the idbtool output.
+ *
+ * Author: Willem Hengeveld <itsme@xs4all.nl>
+ *
+ * Output is collected in a string buffer, and written to the stream
+ * in large blocks. Values are written directly, without building a
+ * document tree first.
+ *
+ *    JsonWriter json(std::cout);
+ *    json.beginobject();
+ *    json.field("name", "abc");
+ *    json.key("list");  json.beginarray();  json.value(1);  json.endarray();
+ *    json.endobject();
+ *    json.newline();
+ *
+ * Strings are written as latin-1: bytes >= 0x80 are escaped as \u00XX,
+ * so the output is always valid json, even for binary names.
+ * Use `hexvalue` for binary data.
+ *
+ * After an error halfway an ndjson record, `reset` drops the partial
+ * record, so the next record starts on a clean line.
+ */
+#pragma once
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <charconv>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+class JsonWriter {
+    std::ostream& _os;
+    std::string _buf;
+    std::vector<bool> _levels;  // the `_comma` state of the enclosing levels
+    std::string _closers;       // the closing brackets for the enclosing levels
+    bool _comma;                // the next item needs a separating comma
+    bool _afterkey;             // the next item is the value for a key
+    size_t _recordstart;        // where the current toplevel item starts in _buf, npos when partly flushed
+
+    enum { FLUSHSIZE = 0x10000 };
+
+    // write the separator for the next item
+    void prefix()
+    {
+        if (_afterkey)
+            _afterkey = false;
+        else if (_comma)
+            _buf += ',';
+        _comma = true;
+    }
+    void writestring(const char *p, size_t n)
+    {
+        static const char hexdigits[] = "0123456789abcdef";
+        _buf += '"';
+        for (size_t i=0 ; i<n ; i++) {
+            uint8_t c = p[i];
+            if (c=='"' || c=='\\') {
+                _buf += '\\';
+                _buf += char(c);
+            }
+            else if (c < 0x20 || c >= 0x80) {
+                switch(c) {
+                    case '\n': _buf += "\\n"; break;
+                    case '\r': _buf += "\\r"; break;
+                    case '\t': _buf += "\\t"; break;
+                    default:
+                        _buf += "\\u00";
+                        _buf += hexdigits[c>>4];
+                        _buf += hexdigits[c&15];
+                }
+            }
+            else {
+                _buf += char(c);
+            }
+        }
+        _buf += '"';
+    }
+    template<typename T>
+    void writeint(T v)
+    {
+        char tmp[24];
+        auto res = std::to_chars(tmp, tmp+sizeof(tmp), v);
+        _buf.append(tmp, res.ptr);
+    }
+public:
+    JsonWriter(std::ostream& os)
+        : _os(os), _comma(false), _afterkey(false), _recordstart(0)
+    {
+        _buf.reserve(FLUSHSIZE+0x1000);
+    }
+    ~JsonWriter()
+    {
+        flush();
+    }
+    void flush()
+    {
+        _os.write(_buf.data(), _buf.size());
+        _buf.clear();
+        _recordstart = _levels.empty() ? 0 : std::string::npos;
+    }
+    // abandon the current toplevel item.
+    // when part of it was already written, it is closed instead.
+    void reset()
+    {
+        if (_recordstart != std::string::npos) {
+            _buf.resize(_recordstart);
+        }
+        else {
+            if (_afterkey)
+                _buf += "null";
+            _buf.append(_closers.rbegin(), _closers.rend());
+            _buf += '\n';
+        }
+        _levels.clear();
+        _closers.clear();
+        _comma = false;
+        _afterkey = false;
+        _recordstart = _buf.size();
+    }
+
+    void beginobject()
+    {
+        prefix();
+        _buf += '{';
+        _levels.push_back(_comma);
+        _closers += '}';
+        _comma = false;
+    }
+    void endobject()
+    {
+        _buf += '}';
+        _comma = _levels.back();
+        _levels.pop_back();
+        _closers.pop_back();
+        if (_buf.size() >= FLUSHSIZE)
+            flush();
+    }
+    void beginarray()
+    {
+        prefix();
+        _buf += '[';
+        _levels.push_back(_comma);
+        _closers += ']';
+        _comma = false;
+    }
+    void endarray()
+    {
+        _buf += ']';
+        _comma = _levels.back();
+        _levels.pop_back();
+        _closers.pop_back();
+        if (_buf.size() >= FLUSHSIZE)
+            flush();
+    }
+    // ends a toplevel item, for ndjson output.
+    void newline()
+    {
+        _buf += '\n';
+        _comma = false;
+        _recordstart = _buf.size();
+        if (_buf.size() >= FLUSHSIZE)
+            flush();
+    }
+    void key(const char *name)
+    {
+        prefix();
+        writestring(name, strlen(name));
+        _buf += ':';
+        _afterkey = true;
+    }
+
+    void value(const std::string& s) { prefix(); writestring(s.data(), s.size()); }
+    void value(const char *s) { prefix(); writestring(s, strlen(s)); }
+    void value(bool b) { prefix(); _buf += b ? "true" : "false"; }
+    void value(int v) { prefix(); writeint(v); }
+    void value(unsigned v) { prefix(); writeint(v); }
+    void value(int64_t v) { prefix(); writeint(v); }
+    void value(uint64_t v) { prefix(); writeint(v); }
+    void value(double v)
+    {
+        prefix();
+        char tmp[32];
+        int n = snprintf(tmp, sizeof(tmp), "%.3f", v);
+        _buf.append(tmp, n);
+    }
+    void nullvalue() { prefix(); _buf += "null"; }
+
+    // binary data as a string of hex digits
+    void hexvalue(std::string_view data)
+    {
+        static const char hexdigits[] = "0123456789abcdef";
+        prefix();
+        _buf += '"';
+        for (uint8_t c : data) {
+            _buf += hexdigits[c>>4];
+            _buf += hexdigits[c&15];
+        }
+        _buf += '"';
+    }
+
+    template<typename T>
+    void field(const char *name, const T& v)
+    {
+        key(name);
+        value(v);
+    }
+    void hexfield(const char *name, std::string_view data)
+    {
+        key(name);
+        hexvalue(data);
+    }
+};